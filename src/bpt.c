@@ -0,0 +1,595 @@
+//========================================================//
+//  bpt.c                                                 //
+//  Source file for the columnar branch trace format      //
+//                                                        //
+//  Layout (host byte order):                             //
+//    header, PC dictionary (zigzag delta varints),       //
+//    blocks of BPT_BLOCK_BRANCHES branches, each a       //
+//    BptBlockHeader, the PC-ID column and the outcome    //
+//    column, covered by an FNV-1a checksum.              //
+//                                                        //
+//  The PC-ID column stores varint run lengths of IDs the //
+//  model predicts correctly (match model, else last      //
+//  successor of the previous branch), each followed by a //
+//  zigzag delta varint from the mispredicted ID.  The    //
+//  outcome column is range coded under the match model  //
+//  or a (PC, local, global history) context, or stored   //
+//  as packed bits when BPT_PACKED is set.                //
+//========================================================//
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bpt.h"
+
+#define HASH_MUL   0x9E3779B1u
+#define FNV_OFFSET 2166136261u
+#define FNV_PRIME  16777619u
+
+// Adaptive probabilities use a 1/(n+2) rate for their first updates,
+// then a fixed 1/32 rate
+#define PROB_FAST_UPDATES 30
+#define PROB_MIN          32
+#define PROB_MAX          (65535 - 32)
+
+//------------------------------------//
+//          Helper Functions          //
+//------------------------------------//
+
+typedef struct {
+    uint8_t *data;
+    size_t   len, cap;
+} BptBuf;
+
+static void buf_grow(BptBuf *b, size_t extra) {
+    if (b->len + extra > b->cap) {
+        while (b->len + extra > b->cap) {
+            b->cap = b->cap ? b->cap * 2 : 4096;
+        }
+        b->data = (uint8_t *)realloc(b->data, b->cap);
+    }
+}
+
+static inline void buf_put(BptBuf *b, uint8_t c) {
+    if (b->len == b->cap) {
+        buf_grow(b, 1);
+    }
+    b->data[b->len++] = c;
+}
+
+static inline void put_varint(BptBuf *b, uint32_t v) {
+    while (v >= 0x80) {
+        buf_put(b, (uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    buf_put(b, (uint8_t)v);
+}
+
+static inline uint32_t get_varint(const uint8_t **p, const uint8_t *end) {
+    uint32_t v = 0;
+    for (int shift = 0; *p < end && shift < 32; shift += 7) {
+        uint8_t c = *(*p)++;
+        v |= (uint32_t)(c & 0x7f) << shift;
+        if (!(c & 0x80)) {
+            break;
+        }
+    }
+    return v;
+}
+
+static inline uint32_t zigzag(int32_t v) {
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t v) {
+    return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+static uint32_t checksum(const uint8_t *p, size_t n, uint32_t h) {
+    for (size_t i = 0; i < n; i++) {
+        h = (h ^ p[i]) * FNV_PRIME;
+    }
+    return h;
+}
+
+static inline uint32_t mix(uint32_t a, uint32_t b) {
+    uint32_t h = (a * HASH_MUL) ^ b;
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    return h;
+}
+
+//------------------------------------//
+//             Modelling              //
+//------------------------------------//
+
+static void model_alloc(BptModel *m, uint32_t numPCs, uint32_t blockBranches) {
+    uint32_t pcs = numPCs ? numPCs : 1;
+
+    m->numPCs        = numPCs;
+    m->blockBranches = blockBranches;
+    m->succ       = (uint32_t *)malloc(2 * pcs * sizeof(uint32_t));
+    m->localHist  = (uint8_t *)malloc(pcs * sizeof(uint8_t));
+    m->events     = (uint32_t *)malloc((blockBranches ? blockBranches : 1) * sizeof(uint32_t));
+    m->matchTable = (uint32_t *)malloc((1 << BPT_MATCH_BITS) * sizeof(uint32_t));
+    m->ctx        = (BptProb *)malloc((1 << BPT_CTX_BITS) * sizeof(BptProb));
+
+    m->hashPow = 1;
+    for (int i = 0; i < BPT_MATCH_MIN; i++) {
+        m->hashPow *= HASH_MUL;
+    }
+}
+
+static void model_reset(BptModel *m) {
+    uint32_t pcs = m->numPCs ? m->numPCs : 1;
+
+    memset(m->succ, 0, 2 * pcs * sizeof(uint32_t));
+    memset(m->localHist, 0, pcs * sizeof(uint8_t));
+    memset(m->matchTable, 0, (1 << BPT_MATCH_BITS) * sizeof(uint32_t));
+    for (uint32_t i = 0; i < (1 << BPT_CTX_BITS); i++) {
+        m->ctx[i].p = 32768;
+        m->ctx[i].n = 0;
+    }
+    m->prev = m->global = m->hash = 0;
+    m->ptr = m->len = m->n = 0;
+}
+
+static void model_free(BptModel *m) {
+    free(m->succ);
+    free(m->localHist);
+    free(m->events);
+    free(m->matchTable);
+    free(m->ctx);
+    memset(m, 0, sizeof(*m));
+}
+
+static inline uint32_t model_predict_id(const BptModel *m) {
+    return m->ptr ? (m->events[m->ptr] >> 1) : m->succ[m->prev];
+}
+
+static inline BptProb *model_outcome_ctx(BptModel *m, uint32_t id) {
+    uint32_t h;
+    if (m->ptr && (m->events[m->ptr] >> 1) == id) {
+        // Long matches are trusted more, so the match length is part
+        // of the context along with the predicted outcome
+        uint32_t lenBucket = (m->len >> 4) > 15 ? 15 : (m->len >> 4);
+        h = mix(id, 0x10000 | (lenBucket << 1) | (m->events[m->ptr] & 1));
+    } else {
+        h = mix(id, ((m->localHist[id] & 0xf) << 12) | (m->global & 0xfff));
+    }
+    return &m->ctx[h >> (32 - BPT_CTX_BITS)];
+}
+
+static inline void model_update(BptModel *m, uint32_t id, uint8_t outcome) {
+    uint32_t e = (id << 1) | outcome;
+
+    m->succ[m->prev] = id;
+    m->prev = e;
+    m->localHist[id] = (uint8_t)((m->localHist[id] << 1) | outcome);
+    m->global = (m->global << 1) | outcome;
+
+    // Extend or drop the current match
+    if (m->ptr && m->events[m->ptr] == e) {
+        m->ptr++;
+        m->len++;
+    } else {
+        m->ptr = m->len = 0;
+    }
+    m->events[m->n++] = e;
+
+    // Rolling hash of the last BPT_MATCH_MIN events
+    m->hash = m->hash * HASH_MUL + e + 1;
+    if (m->n > BPT_MATCH_MIN) {
+        m->hash -= (m->events[m->n - 1 - BPT_MATCH_MIN] + 1) * m->hashPow;
+    }
+    if (m->n >= BPT_MATCH_MIN) {
+        uint32_t slot = (m->hash * HASH_MUL) >> (32 - BPT_MATCH_BITS);
+        if (!m->ptr) {
+            m->ptr = m->matchTable[slot];
+            m->len = 0;
+        }
+        m->matchTable[slot] = m->n;
+    }
+}
+
+static const int32_t probRecip[PROB_FAST_UPDATES] = {
+    32768, 21845, 16384, 13107, 10923, 9362, 8192, 7282, 6554, 5958,
+    5461, 5041, 4681, 4369, 4096, 3855, 3641, 3449, 3277, 3121,
+    2979, 2849, 2731, 2621, 2521, 2427, 2341, 2260, 2185, 2114
+};
+
+static inline void prob_update(BptProb *p, int bit) {
+    int32_t delta = (bit ? 65535 : 0) - (int32_t)p->p;
+    if (p->n < PROB_FAST_UPDATES) {
+        delta = (delta * probRecip[p->n]) >> 16;
+        p->n++;
+    } else {
+        delta >>= 5;
+    }
+    int32_t np = (int32_t)p->p + delta;
+    p->p = (uint16_t)(np < PROB_MIN ? PROB_MIN : (np > PROB_MAX ? PROB_MAX : np));
+}
+
+//------------------------------------//
+//            Range Coding            //
+//------------------------------------//
+
+typedef struct {
+    BptBuf  *out;
+    uint64_t low;
+    uint32_t range;
+    uint8_t  cache;
+    uint64_t cacheSize;
+} RcEncoder;
+
+static void rc_init(RcEncoder *rc, BptBuf *out) {
+    rc->out       = out;
+    rc->low       = 0;
+    rc->range     = 0xFFFFFFFFu;
+    rc->cache     = 0;
+    rc->cacheSize = 1;
+}
+
+static void rc_shift_low(RcEncoder *rc) {
+    if ((uint32_t)rc->low < 0xFF000000u || (rc->low >> 32) != 0) {
+        uint8_t carry = (uint8_t)(rc->low >> 32);
+        uint8_t temp  = rc->cache;
+        do {
+            buf_put(rc->out, (uint8_t)(temp + carry));
+            temp = 0xFF;
+        } while (--rc->cacheSize != 0);
+        rc->cache = (uint8_t)(rc->low >> 24);
+    }
+    rc->cacheSize++;
+    rc->low = (rc->low & 0x00FFFFFFu) << 8;
+}
+
+static inline void rc_encode(RcEncoder *rc, BptProb *p, int bit) {
+    uint32_t bound = (rc->range >> 16) * p->p;
+    if (bit) {
+        rc->range = bound;
+    } else {
+        rc->low   += bound;
+        rc->range -= bound;
+    }
+    while (rc->range < (1u << 24)) {
+        rc->range <<= 8;
+        rc_shift_low(rc);
+    }
+    prob_update(p, bit);
+}
+
+static void rc_flush(RcEncoder *rc) {
+    for (int i = 0; i < 5; i++) {
+        rc_shift_low(rc);
+    }
+}
+
+static inline uint8_t rc_next_byte(BptDecoder *d) {
+    return (d->outs < d->outsEnd) ? *d->outs++ : 0;
+}
+
+static inline uint8_t rc_decode(BptDecoder *d, BptProb *p) {
+    uint32_t bound = (d->range >> 16) * p->p;
+    uint8_t bit;
+    if (d->code < bound) {
+        d->range = bound;
+        bit = 1;
+    } else {
+        d->code  -= bound;
+        d->range -= bound;
+        bit = 0;
+    }
+    while (d->range < (1u << 24)) {
+        d->range <<= 8;
+        d->code = (d->code << 8) | rc_next_byte(d);
+    }
+    prob_update(p, bit);
+    return bit;
+}
+
+//------------------------------------//
+//              Encoding              //
+//------------------------------------//
+
+static void encode_block(BptModel *m, const uint32_t *ids, const uint8_t *outcome,
+                         uint32_t n, int packed, BptBuf *idBuf, BptBuf *outBuf) {
+    RcEncoder rc;
+    uint32_t run = 0;
+
+    model_reset(m);
+    rc_init(&rc, outBuf);
+    if (packed) {
+        buf_grow(outBuf, (n + 7) / 8);
+        memset(outBuf->data, 0, (n + 7) / 8);
+        outBuf->len = (n + 7) / 8;
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t id = ids[i];
+        uint32_t pred = model_predict_id(m);
+        if (id == pred) {
+            run++;
+        } else {
+            put_varint(idBuf, run);
+            put_varint(idBuf, zigzag((int32_t)(id - pred)));
+            run = 0;
+        }
+
+        if (packed) {
+            outBuf->data[i >> 3] |= (uint8_t)(outcome[i] << (i & 7));
+        } else {
+            rc_encode(&rc, model_outcome_ctx(m, id), outcome[i]);
+        }
+        model_update(m, id, outcome[i]);
+    }
+    put_varint(idBuf, run);
+
+    if (!packed) {
+        rc_flush(&rc);
+    }
+}
+
+// Assign dictionary IDs in order of first appearance
+static uint32_t *build_dictionary(const uint32_t *pc, uint64_t n,
+                                  uint32_t **dict, uint32_t *numPCs) {
+    uint32_t size = 1024, used = 0;
+    uint32_t *slotPC = (uint32_t *)malloc(size * sizeof(uint32_t));
+    uint32_t *slotID = (uint32_t *)malloc(size * sizeof(uint32_t));
+    uint32_t *ids    = (uint32_t *)malloc((n ? n : 1) * sizeof(uint32_t));
+    uint32_t dictCap = 256;
+
+    *dict = (uint32_t *)malloc(dictCap * sizeof(uint32_t));
+    memset(slotID, 0xff, size * sizeof(uint32_t));
+
+    for (uint64_t i = 0; i < n; i++) {
+        uint32_t s = mix(pc[i], 0) & (size - 1);
+        while (slotID[s] != UINT32_MAX && slotPC[s] != pc[i]) {
+            s = (s + 1) & (size - 1);
+        }
+        if (slotID[s] == UINT32_MAX) {
+            if (used == dictCap) {
+                dictCap *= 2;
+                *dict = (uint32_t *)realloc(*dict, dictCap * sizeof(uint32_t));
+            }
+            (*dict)[used] = pc[i];
+            slotPC[s] = pc[i];
+            slotID[s] = used++;
+
+            // Keep the table at most half full
+            if (used * 2 > size) {
+                uint32_t oldSize = size;
+                uint32_t *oldPC = slotPC, *oldID = slotID;
+                size *= 2;
+                slotPC = (uint32_t *)malloc(size * sizeof(uint32_t));
+                slotID = (uint32_t *)malloc(size * sizeof(uint32_t));
+                memset(slotID, 0xff, size * sizeof(uint32_t));
+                for (uint32_t j = 0; j < oldSize; j++) {
+                    if (oldID[j] != UINT32_MAX) {
+                        uint32_t t = mix(oldPC[j], 0) & (size - 1);
+                        while (slotID[t] != UINT32_MAX) {
+                            t = (t + 1) & (size - 1);
+                        }
+                        slotPC[t] = oldPC[j];
+                        slotID[t] = oldID[j];
+                    }
+                }
+                free(oldPC);
+                free(oldID);
+            }
+            ids[i] = used - 1;
+        } else {
+            ids[i] = slotID[s];
+        }
+    }
+
+    free(slotPC);
+    free(slotID);
+    *numPCs = used;
+    return ids;
+}
+
+int bpt_encode(FILE *f, const uint32_t *pc, const uint8_t *outcome,
+               uint64_t n, int packed) {
+    uint32_t *dict, numPCs;
+    uint32_t *ids = build_dictionary(pc, n, &dict, &numPCs);
+    BptBuf dictBuf = { 0 }, idBuf = { 0 }, outBuf = { 0 };
+    int ok = 1;
+
+    uint32_t last = 0;
+    for (uint32_t i = 0; i < numPCs; i++) {
+        put_varint(&dictBuf, zigzag((int32_t)(dict[i] - last)));
+        last = dict[i];
+    }
+
+    uint32_t head[2] = { BPT_MAGIC, BPT_VERSION };
+    uint32_t info[4] = { numPCs, (uint32_t)dictBuf.len,
+                         checksum(dictBuf.data, dictBuf.len, FNV_OFFSET),
+                         BPT_BLOCK_BRANCHES };
+    ok = fwrite(head, sizeof(head), 1, f) == 1
+      && fwrite(&n, sizeof(n), 1, f) == 1
+      && fwrite(info, sizeof(info), 1, f) == 1
+      && fwrite(dictBuf.data, 1, dictBuf.len, f) == dictBuf.len;
+
+    BptModel m;
+    model_alloc(&m, numPCs, BPT_BLOCK_BRANCHES);
+    for (uint64_t start = 0; start < n && ok; start += BPT_BLOCK_BRANCHES) {
+        uint32_t count = (n - start < BPT_BLOCK_BRANCHES)
+                       ? (uint32_t)(n - start) : BPT_BLOCK_BRANCHES;
+        idBuf.len = outBuf.len = 0;
+        encode_block(&m, ids + start, outcome + start, count, packed, &idBuf, &outBuf);
+
+        BptBlockHeader bh;
+        bh.branches = count;
+        bh.flags    = packed ? BPT_PACKED : 0;
+        bh.idBytes  = (uint32_t)idBuf.len;
+        bh.outBytes = (uint32_t)outBuf.len;
+        bh.checksum = checksum(outBuf.data, outBuf.len,
+                               checksum(idBuf.data, idBuf.len, FNV_OFFSET));
+        ok = fwrite(&bh, sizeof(bh), 1, f) == 1
+          && fwrite(idBuf.data, 1, idBuf.len, f) == idBuf.len
+          && fwrite(outBuf.data, 1, outBuf.len, f) == outBuf.len;
+    }
+
+    model_free(&m);
+    free(ids);
+    free(dict);
+    free(dictBuf.data);
+    free(idBuf.data);
+    free(outBuf.data);
+    return ok;
+}
+
+//------------------------------------//
+//              Decoding              //
+//------------------------------------//
+
+int bpt_open(BptDecoder *d, FILE *f) {
+    uint32_t version, info[4];
+
+    memset(d, 0, sizeof(*d));
+    if (fread(&version, sizeof(version), 1, f) != 1 || version != BPT_VERSION
+        || fread(&d->h.branches, sizeof(d->h.branches), 1, f) != 1
+        || fread(info, sizeof(info), 1, f) != 1) {
+        fprintf(stderr, "bpt: bad header\n");
+        return 0;
+    }
+    d->h.numPCs        = info[0];
+    d->h.dictBytes     = info[1];
+    d->h.dictChecksum  = info[2];
+    d->h.blockBranches = info[3];
+    if (d->h.blockBranches == 0 || d->h.blockBranches > (1u << 26)) {
+        fprintf(stderr, "bpt: bad block size\n");
+        return 0;
+    }
+
+    uint8_t *raw = (uint8_t *)malloc(d->h.dictBytes ? d->h.dictBytes : 1);
+    if (fread(raw, 1, d->h.dictBytes, f) != d->h.dictBytes
+        || checksum(raw, d->h.dictBytes, FNV_OFFSET) != d->h.dictChecksum) {
+        fprintf(stderr, "bpt: dictionary checksum mismatch\n");
+        free(raw);
+        return 0;
+    }
+
+    d->dict = (uint32_t *)malloc((d->h.numPCs ? d->h.numPCs : 1) * sizeof(uint32_t));
+    const uint8_t *p = raw, *end = raw + d->h.dictBytes;
+    uint32_t last = 0;
+    for (uint32_t i = 0; i < d->h.numPCs; i++) {
+        last += (uint32_t)unzigzag(get_varint(&p, end));
+        d->dict[i] = last;
+    }
+    free(raw);
+
+    model_alloc(&d->m, d->h.numPCs, d->h.blockBranches);
+    return 1;
+}
+
+int bpt_read_block_header(FILE *f, BptBlockHeader *bh) {
+    return fread(bh, sizeof(*bh), 1, f) == 1;
+}
+
+int bpt_skip_payload(FILE *f, const BptBlockHeader *bh) {
+    uint64_t bytes = (uint64_t)bh->idBytes + bh->outBytes;
+    if (fseeko(f, (off_t)bytes, SEEK_CUR) == 0) {
+        return 1;
+    }
+
+    // Not seekable (stdin), read and discard
+    char scratch[4096];
+    while (bytes > 0) {
+        size_t chunk = bytes < sizeof(scratch) ? (size_t)bytes : sizeof(scratch);
+        if (fread(scratch, 1, chunk, f) != chunk) {
+            return 0;
+        }
+        bytes -= chunk;
+    }
+    return 1;
+}
+
+int bpt_load_block(BptDecoder *d, FILE *f, const BptBlockHeader *bh) {
+    size_t bytes = (size_t)bh->idBytes + bh->outBytes;
+
+    d->left = 0;
+    if (bh->branches > d->h.blockBranches
+        || ((bh->flags & BPT_PACKED) && bh->outBytes < (bh->branches + 7) / 8)) {
+        fprintf(stderr, "bpt: bad block header\n");
+        d->error = 1;
+        return 0;
+    }
+    if (bytes > d->payloadCap) {
+        d->payloadCap = bytes;
+        d->payload = (uint8_t *)realloc(d->payload, d->payloadCap);
+    }
+    if (fread(d->payload, 1, bytes, f) != bytes) {
+        fprintf(stderr, "bpt: truncated block\n");
+        d->error = 1;
+        return 0;
+    }
+    if (checksum(d->payload, bytes, FNV_OFFSET) != bh->checksum) {
+        fprintf(stderr, "bpt: block checksum mismatch\n");
+        d->error = 1;
+        return 0;
+    }
+
+    d->flags   = bh->flags;
+    d->ids     = d->payload;
+    d->idsEnd  = d->payload + bh->idBytes;
+    d->outs    = d->idsEnd;
+    d->outsEnd = d->outs + bh->outBytes;
+    d->bit     = 0;
+
+    model_reset(&d->m);
+    d->runLeft = get_varint(&d->ids, d->idsEnd);
+    if (!(d->flags & BPT_PACKED)) {
+        d->range = 0xFFFFFFFFu;
+        d->code  = 0;
+        for (int i = 0; i < 5; i++) {
+            d->code = (d->code << 8) | rc_next_byte(d);
+        }
+    }
+    d->left = bh->branches;
+    return 1;
+}
+
+int bpt_next(BptDecoder *d, uint32_t *pc, uint8_t *outcome) {
+    if (d->left == 0) {
+        return 0;
+    }
+
+    BptModel *m = &d->m;
+    uint32_t id = model_predict_id(m);
+    if (d->runLeft) {
+        d->runLeft--;
+    } else {
+        id += (uint32_t)unzigzag(get_varint(&d->ids, d->idsEnd));
+        d->runLeft = get_varint(&d->ids, d->idsEnd);
+    }
+    if (id >= m->numPCs) {
+        fprintf(stderr, "bpt: corrupt id column\n");
+        d->left = 0;
+        d->error = 1;
+        return 0;
+    }
+
+    uint8_t o;
+    if (d->flags & BPT_PACKED) {
+        o = (d->outs[d->bit >> 3] >> (d->bit & 7)) & 1;
+        d->bit++;
+    } else {
+        o = rc_decode(d, model_outcome_ctx(m, id));
+    }
+    model_update(m, id, o);
+
+    *pc = d->dict[id];
+    *outcome = o;
+    d->left--;
+    return 1;
+}
+
+void bpt_close(BptDecoder *d) {
+    model_free(&d->m);
+    free(d->dict);
+    free(d->payload);
+    memset(d, 0, sizeof(*d));
+}
@@ -0,0 +1,140 @@
+//========================================================//
+//  bpt.h                                                 //
+//  Header file for the columnar branch trace format      //
+//                                                        //
+//  A .bpt file holds a dictionary of unique PCs followed //
+//  by independently decodable blocks, each with a PC-ID  //
+//  column and an outcome column                          //
+//========================================================//
+
+#ifndef BPT_H
+#define BPT_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+//------------------------------------//
+//        Columnar Trace Defines      //
+//------------------------------------//
+#define BPT_MAGIC          0x43545042 // "BPTC"
+#define BPT_VERSION        1
+#define BPT_BLOCK_BRANCHES (1 << 20)
+
+// Block flags
+#define BPT_PACKED 1 // outcome column is a raw bitstream, not range coded
+
+// Match model: the event (id, outcome) following the last occurrence
+// of the previous BPT_MATCH_MIN events predicts the next one
+#define BPT_MATCH_MIN  12
+#define BPT_MATCH_BITS 18
+
+// Outcome context table
+#define BPT_CTX_BITS   20
+
+typedef struct {
+    uint16_t p; // probability of TAKEN, 16-bit fixed point
+    uint16_t n; // updates seen, sets the adaptation rate
+} BptProb;
+
+// Modelling state shared by the encoder and decoder.  It is reset at
+// every block so blocks can be decoded independently
+typedef struct {
+    uint32_t  numPCs;
+    uint32_t  blockBranches;
+    uint32_t *succ;       // last successor of each (id, outcome) event
+    uint8_t  *localHist;  // per-id outcome history
+    uint32_t *events;     // events of the current block
+    uint32_t *matchTable; // rolling hash => position after the match
+    BptProb  *ctx;        // outcome probabilities
+    uint32_t  prev;       // previous event
+    uint32_t  global;     // global outcome history
+    uint32_t  hash;       // rolling hash of the last BPT_MATCH_MIN events
+    uint32_t  hashPow;    // multiplier of the event leaving the hash
+    uint32_t  ptr;        // match position (0 => no match)
+    uint32_t  len;        // match length
+    uint32_t  n;          // events in the current block
+} BptModel;
+
+typedef struct {
+    uint64_t branches;
+    uint32_t numPCs;
+    uint32_t dictBytes;
+    uint32_t dictChecksum;
+    uint32_t blockBranches;
+} BptHeader;
+
+typedef struct {
+    uint32_t branches;
+    uint32_t flags;
+    uint32_t idBytes;
+    uint32_t outBytes;
+    uint32_t checksum;
+} BptBlockHeader;
+
+typedef struct {
+    BptHeader h;
+    uint32_t *dict;
+    BptModel  m;
+
+    // Current block
+    uint8_t  *payload;
+    size_t    payloadCap;
+    uint32_t  flags;
+    uint32_t  left;       // branches not yet decoded
+    const uint8_t *ids, *idsEnd;
+    const uint8_t *outs, *outsEnd;
+    uint32_t  runLeft;    // predicted ids before the next escape
+    uint32_t  bit;        // packed outcome position
+    uint32_t  range, code;
+    int       error;      // set once the stream is found to be corrupt
+} BptDecoder;
+
+//------------------------------------//
+//  Columnar Trace Function Prototypes//
+//------------------------------------//
+
+// Encode 'n' branches into a .bpt stream on 'f'.  If 'packed' is set the
+// outcome column is stored as raw bits (faster, larger)
+//
+// Returns True if Successful
+//
+int bpt_encode(FILE *f, const uint32_t *pc, const uint8_t *outcome,
+               uint64_t n, int packed);
+
+// Read the file header and PC dictionary.  The 4-byte magic must
+// already have been consumed
+//
+// Returns True if Successful
+//
+int bpt_open(BptDecoder *d, FILE *f);
+
+// Read the next block header
+//
+// Returns True if Successful, False at the end of the file
+//
+int bpt_read_block_header(FILE *f, BptBlockHeader *bh);
+
+// Skip the payload of a block without decoding it
+//
+// Returns True if Successful
+//
+int bpt_skip_payload(FILE *f, const BptBlockHeader *bh);
+
+// Read and verify the payload of a block and start decoding it.  A bad
+// or truncated block sets the decoder's error flag
+//
+// Returns True if Successful
+//
+int bpt_load_block(BptDecoder *d, FILE *f, const BptBlockHeader *bh);
+
+// Decode the next branch of the current block.  A corrupt id column
+// sets the decoder's error flag
+//
+// Returns True if Successful, False once the block is exhausted or on
+// an error
+//
+int bpt_next(BptDecoder *d, uint32_t *pc, uint8_t *outcome);
+
+void bpt_close(BptDecoder *d);
+
+#endif
@@ -0,0 +1,172 @@
+//========================================================//
+//  interval.c                                            //
+//  Source file for interval statistics                   //
+//                                                        //
+//  The time series is a CSV with one row per interval:   //
+//  first branch, branches, mispredictions, rate per      //
+//  1000 branches, phase-change flag, then branches and   //
+//  mispredictions of every predictor component.          //
+//========================================================//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "interval.h"
+
+uint32_t intervalSize = 0;
+const char *intervalPath = DEFAULT_INTERVAL_PATH;
+
+IntervalCounts intervalNow;
+
+//------------------------------------//
+//    Interval Statistics State       //
+//------------------------------------//
+
+typedef struct {
+    uint64_t start;          // first branch of the phase
+    uint64_t branches;
+    uint64_t mispredictions;
+} Phase;
+
+static FILE    *intervalOut = NULL;
+static uint64_t intervalIndex;
+static uint64_t intervalStart;   // first branch of the current interval
+
+// Detector state for the current phase
+static double   phaseMean;       // mean interval rate
+static uint64_t phaseIntervals;
+static double   phaseUp, phaseDown;
+
+static Phase   *phases = NULL;
+static uint64_t numPhases, phaseCap;
+
+//------------------------------------//
+//    Interval Statistics Functions   //
+//------------------------------------//
+
+// Start a new phase at branch 'start'
+//
+// Returns True if Successful
+//
+static int phase_begin(uint64_t start) {
+    if (numPhases == phaseCap) {
+        uint64_t cap = phaseCap ? phaseCap * 2 : 16;
+        Phase *p = (Phase *)realloc(phases, cap * sizeof(Phase));
+        if (!p) {
+            fprintf(stderr, "interval: cannot allocate %llu phases\n",
+                    (unsigned long long)cap);
+            return 0;
+        }
+        phases = p;
+        phaseCap = cap;
+    }
+    phases[numPhases].start = start;
+    phases[numPhases].branches = 0;
+    phases[numPhases].mispredictions = 0;
+    numPhases++;
+
+    phaseMean = 0;
+    phaseIntervals = 0;
+    phaseUp = phaseDown = 0;
+    return 1;
+}
+
+// Feed one interval rate to the detector
+//
+// Returns True if it starts a new phase
+//
+static int phase_detect(double rate) {
+    if (phaseIntervals > 0) {
+        double tolerance = PHASE_TOLERANCE_REL * phaseMean;
+        double threshold = PHASE_THRESHOLD_REL * phaseMean;
+        if (tolerance < PHASE_TOLERANCE_ABS) tolerance = PHASE_TOLERANCE_ABS;
+        if (threshold < PHASE_THRESHOLD_ABS) threshold = PHASE_THRESHOLD_ABS;
+
+        phaseUp   += rate - phaseMean - tolerance;
+        phaseDown += phaseMean - rate - tolerance;
+        if (phaseUp < 0)   phaseUp = 0;
+        if (phaseDown < 0) phaseDown = 0;
+
+        if (phaseUp > threshold || phaseDown > threshold) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int interval_init(uint64_t firstBranch) {
+    memset(&intervalNow, 0, sizeof(intervalNow));
+    intervalIndex = 0;
+    intervalStart = firstBranch;
+    numPhases = 0;
+    if (!phase_begin(firstBranch)) {
+        return 0;
+    }
+
+    intervalOut = fopen(intervalPath, "w");
+    if (!intervalOut) {
+        return 0;
+    }
+    fprintf(intervalOut, "interval,first_branch,branches,mispredictions,mpkb,phase_change");
+    for (int c = 0; c < num_components(); c++) {
+        fprintf(intervalOut, ",%s_branches,%s_mispredictions",
+                component_name(c), component_name(c));
+    }
+    fprintf(intervalOut, "\n");
+    return 1;
+}
+
+int interval_flush() {
+    IntervalCounts *n = &intervalNow;
+    if (n->branches == 0) {
+        return 1;
+    }
+
+    double rate = 1000.0 * n->mispredictions / n->branches;
+    int change = phase_detect(rate);
+    if (change && !phase_begin(intervalStart)) {
+        return 0;
+    }
+
+    // Fold the interval into the phase mean and totals
+    phaseIntervals++;
+    phaseMean += (rate - phaseMean) / phaseIntervals;
+    phases[numPhases - 1].branches += n->branches;
+    phases[numPhases - 1].mispredictions += n->mispredictions;
+
+    fprintf(intervalOut, "%llu,%llu,%u,%u,%.3f,%d",
+            (unsigned long long)intervalIndex, (unsigned long long)intervalStart,
+            n->branches, n->mispredictions, rate, change);
+    for (int c = 0; c < num_components(); c++) {
+        fprintf(intervalOut, ",%u,%u", n->compBranches[c], n->compMispredictions[c]);
+    }
+    fprintf(intervalOut, "\n");
+
+    intervalIndex++;
+    intervalStart += n->branches;
+    memset(n, 0, sizeof(*n));
+    return 1;
+}
+
+int interval_finish() {
+    int ok = interval_flush();
+    fclose(intervalOut);
+    intervalOut = NULL;
+
+    if (ok) {
+        printf("Intervals:       %10llu x %u branches (%s)\n",
+               (unsigned long long)intervalIndex, intervalSize, intervalPath);
+        printf("Phase changes:   %10llu\n", (unsigned long long)(numPhases - 1));
+        for (uint64_t p = 0; p < numPhases; p++) {
+            double rate = phases[p].branches
+                          ? 1000.0 * phases[p].mispredictions / phases[p].branches : 0;
+            printf("  phase %3llu: branches %10llu - %10llu  mpkb %8.3f\n",
+                   (unsigned long long)p, (unsigned long long)phases[p].start,
+                   (unsigned long long)(phases[p].start + phases[p].branches), rate);
+        }
+    }
+
+    free(phases);
+    phases = NULL;
+    phaseCap = 0;
+    return ok;
+}
@@ -0,0 +1,85 @@
+//========================================================//
+//  interval.h                                            //
+//  Header file for interval statistics                   //
+//                                                        //
+//  Records mispredictions per fixed-size window of       //
+//  branches, per predictor component, and flags phase    //
+//  changes with an online detector                       //
+//========================================================//
+
+#ifndef INTERVAL_H
+#define INTERVAL_H
+
+#include <stdint.h>
+#include "predictor.h"
+
+//------------------------------------//
+//      Interval Statistics Defines   //
+//------------------------------------//
+#define DEFAULT_INTERVAL_PATH "interval.csv"
+
+// Page-Hinkley style detector on the per-interval misprediction rate
+// (mispredictions per 1000 branches).  Drifts smaller than the
+// tolerance are ignored, a phase change is flagged once the cumulative
+// deviation from the current phase mean exceeds the threshold.  Both
+// scale with the phase mean but never drop below the absolute floors
+#define PHASE_TOLERANCE_REL 0.10
+#define PHASE_TOLERANCE_ABS 0.5
+#define PHASE_THRESHOLD_REL 1.0
+#define PHASE_THRESHOLD_ABS 5.0
+
+extern uint32_t intervalSize;    // Branches per interval (0 => off)
+extern const char *intervalPath; // Time series output file
+
+typedef struct {
+    uint32_t branches;
+    uint32_t mispredictions;
+    uint32_t compBranches[NUM_COMPONENTS_MAX];
+    uint32_t compMispredictions[NUM_COMPONENTS_MAX];
+} IntervalCounts;
+
+extern IntervalCounts intervalNow;
+
+//------------------------------------//
+//  Interval Statistics Prototypes    //
+//------------------------------------//
+
+// Open the time series and write its header.  Must be called after the
+// predictor type is configured.  'firstBranch' numbers the first
+// recorded branch, e.g. the start of a trace window
+//
+// Returns True if Successful
+//
+int interval_init(uint64_t firstBranch);
+
+// Write out the current interval and run the phase detector
+//
+// Returns True if Successful
+//
+int interval_flush();
+
+// Flush the last partial interval, close the time series and print a
+// summary of the detected phases on stdout
+//
+// Returns True if Successful
+//
+int interval_finish();
+
+// Account for one branch predicted by 'component'
+//
+// Returns True if Successful
+//
+static inline int
+interval_record(uint8_t mispredicted, int component)
+{
+    intervalNow.branches++;
+    intervalNow.mispredictions += mispredicted;
+    intervalNow.compBranches[component]++;
+    intervalNow.compMispredictions[component] += mispredicted;
+    if (intervalNow.branches == intervalSize) {
+        return interval_flush();
+    }
+    return 1;
+}
+
+#endif
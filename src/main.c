@@ -8,11 +8,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "interval.h"
+#include "pipeline.h"
 #include "predictor.h"
+#include "smt.h"
+#include "sweep.h"
+#include "trace.h"
 
-FILE *stream;
-char *buf = NULL;
-size_t len = 0;
+Trace trace;
+unsigned long long windowStart = 0;
+unsigned long long windowCount = 0;
 
 // Print out the Usage information to stderr
 //
@@ -20,15 +25,78 @@ void
 usage()
 {
   fprintf(stderr,"Usage: predictor <options> [<trace>]\n");
+  fprintf(stderr,"       predictor <options> --smt:<policy> <trace> <trace> ...\n");
+  fprintf(stderr,"       predictor <options> trace.bz2\n");
   fprintf(stderr,"       bunzip -kc trace.bz2 | predictor <options>\n");
   fprintf(stderr," Options:\n");
   fprintf(stderr," --help       Print this message\n");
   fprintf(stderr," --verbose    Print predictions on stdout\n");
+  fprintf(stderr," --seed:<n>   Seed of the custom predictor's RNG and of random\n"
+                 "              SMT fetch (default %d)\n",
+          DEFAULT_RNG_SEED);
+  fprintf(stderr," --window:<start>:<count>\n"
+                 "              Only simulate <count> branches (0 => all) starting\n"
+                 "              at branch <start>, seeking with the trace's index\n"
+                 "              (see tracetool) when one exists\n");
+  fprintf(stderr," --cache[:<MB>]\n"
+                 "              Read the trace from the decoded copy shared in\n"
+                 "              %s, decoding it there first if needed.\n"
+                 "              The cache is kept under <MB> (default %d)\n",
+          trace_cache_dir(), TRACE_CACHE_MB);
+  fprintf(stderr," --delay:<n>  Update the predictor <n> branches after predicting,\n"
+                 "              with speculative global history (max %d)\n",
+          PIPELINE_MAX_DELAY);
+  fprintf(stderr," --interval:<n>[:<file>]\n"
+                 "              Write mispredictions per <n> branches, split by\n"
+                 "              predictor component, to <file> (default %s) and\n"
+                 "              report detected phase changes\n",
+          DEFAULT_INTERVAL_PATH);
+  fprintf(stderr," --smt:<policy>\n"
+                 "              Interleave the traces, one per hardware context,\n"
+                 "              into one shared predictor and report each\n"
+                 "              context's interference.  Policies:\n"
+                 "    rr           round-robin, one branch per turn\n"
+                 "    quantum:<n>  round-robin, <n> branches per turn\n"
+                 "    random[:<n>] random context for each turn of <n>\n"
+                 "                 branches (default 1), seeded by --seed\n");
+  fprintf(stderr," --smt-history:<shared|private>\n"
+                 "              Whether contexts share one global history\n"
+                 "              (default shared)\n");
   fprintf(stderr," --<type>     Branch prediction scheme:\n");
   fprintf(stderr,"    static\n"
                  "    gshare:<# ghistory>\n"
                  "    tournament:<# ghistory>:<# lhistory>:<# index>\n"
-                 "    custom\n");
+                 "    custom[:<component>,...]\n"
+                 "        components: loop (loop predictor),\n"
+                 "                    sc (statistical corrector)\n");
+  fprintf(stderr," --sweep:<spec>  Simulate a family of configurations in one pass,\n"
+                 "                 spec is a comma separated list of\n"
+                 "    gshare:<# ghistory>[-<# ghistory>]\n"
+                 "    bimodal:<# index>[-<# index>]\n");
+}
+
+// Enable the optional components of the custom predictor listed in
+// 'list', separated by commas, and only those
+//
+// Returns True if Successful
+//
+int
+parse_custom_components(const char *list)
+{
+  char *buf = strdup(list);
+  int ok = buf != NULL;
+  customLoop = customSC = 0;
+  for (char *c = ok ? strtok(buf, ",") : NULL; c && ok; c = strtok(NULL, ",")) {
+    if (!strcmp(c, "loop")) {
+      customLoop = 1;
+    } else if (!strcmp(c, "sc")) {
+      customSC = 1;
+    } else {
+      ok = 0;
+    }
+  }
+  free(buf);
+  return ok && (customLoop || customSC);
 }
 
 // Process an option and update the predictor
@@ -49,6 +117,45 @@ handle_option(char *arg)
     sscanf(arg+13,"%d:%d:%d", &ghistoryBits, &lhistoryBits, &pcIndexBits);
   } else if (!strcmp(arg,"--custom")) {
     bpType = CUSTOM;
+    customLoop = customSC = 0;
+  } else if (!strncmp(arg,"--custom:",9)) {
+    bpType = CUSTOM;
+    return parse_custom_components(arg+9);
+  } else if (!strncmp(arg,"--sweep:",8)) {
+    return sweep_parse(arg+8);
+  } else if (!strncmp(arg,"--window:",9)) {
+    return sscanf(arg+9,"%llu:%llu", &windowStart, &windowCount) >= 1;
+  } else if (!strcmp(arg,"--cache")) {
+    traceCacheLimit = (uint64_t)TRACE_CACHE_MB << 20;
+  } else if (!strncmp(arg,"--cache:",8)) {
+    unsigned long long mb;
+    if (sscanf(arg+8,"%llu", &mb) != 1 || mb == 0) {
+      return 0;
+    }
+    traceCacheLimit = (uint64_t)mb << 20;
+  } else if (!strncmp(arg,"--smt:",6)) {
+    return smt_parse(arg+6);
+  } else if (!strcmp(arg,"--smt-history:shared")) {
+    smtPrivateHistory = 0;
+  } else if (!strcmp(arg,"--smt-history:private")) {
+    smtPrivateHistory = 1;
+  } else if (!strncmp(arg,"--delay:",8)) {
+    return sscanf(arg+8,"%d", &updateDelay) == 1 &&
+           updateDelay >= 0 && updateDelay <= PIPELINE_MAX_DELAY;
+  } else if (!strncmp(arg,"--interval:",11)) {
+    char *sep = strchr(arg+11, ':');
+    if (sscanf(arg+11,"%u", &intervalSize) != 1 || intervalSize == 0) {
+      return 0;
+    }
+    if (sep) {
+      intervalPath = sep+1;
+    }
+  } else if (!strncmp(arg,"--seed:",7)) {
+    unsigned long long seed;
+    if (sscanf(arg+7,"%llu", &seed) != 1) {
+      return 0;
+    }
+    rngSeed = seed;
   } else if (!strcmp(arg,"--verbose")) {
     verbose = 1;
   } else {
@@ -58,30 +165,32 @@ handle_option(char *arg)
   return 1;
 }
 
-// Reads a line from the input stream and extracts the
-// PC and Outcome of a branch
+// Reads the next branch from the trace and extracts the
+// PC and Outcome of a branch.  Exits if the trace turns out to be
+// corrupt, rather than print statistics of a partial run
 //
 // Returns True if Successful
 //
 int
 read_branch(uint32_t *pc, uint8_t *outcome)
 {
-  if (getline(&buf, &len, stream) == -1) {
-    return 0;
+  if (trace_next(&trace, pc, outcome)) {
+    return 1;
   }
-
-  uint32_t tmp;
-  sscanf(buf,"0x%x %d\n",pc,&tmp);
-  *outcome = tmp;
-
-  return 1;
+  if (trace.error) {
+    fprintf(stderr, "Trace is corrupt or truncated\n");
+    exit(1);
+  }
+  return 0;
 }
 
 int
 main(int argc, char *argv[])
 {
   // Set defaults
-  stream = stdin;
+  const char *path = NULL;
+  const char **paths = (const char **)malloc(argc * sizeof(char *));
+  int numPaths = 0;
   bpType = STATIC;
   verbose = 0;
 
@@ -98,33 +207,115 @@ main(int argc, char *argv[])
       }
     } else {
       // Use as input file
-      stream = fopen(argv[i], "r");
+      path = argv[i];
+      paths[numPaths++] = argv[i];
     }
   }
 
-  // Initialize the predictor
-  init_predictor();
+  // SMT mode reads every trace itself, several times
+  if (smtPolicy != SMT_OFF) {
+    if (numPaths == 0 || updateDelay >= 0 || intervalSize || sweepLanes > 0 ||
+        windowStart || windowCount || verbose) {
+      fprintf(stderr, "--smt needs trace files and does not combine with "
+                      "--delay, --interval, --sweep, --window or --verbose\n");
+      exit(1);
+    }
+    if (!smt_run(paths, numPaths)) {
+      exit(1);
+    }
+    uint64_t branches = 0, incorrect = 0;
+    for (int i = 0; i < smtContexts; i++) {
+      branches  += smtContext[i].branches;
+      incorrect += smtContext[i].mispredictions;
+    }
+    printf("Branches:        %10llu\n", (unsigned long long)branches);
+    printf("Incorrect:       %10llu\n", (unsigned long long)incorrect);
+    printf("Misprediction Rate: %7.3f\n",
+           branches ? 100.0 * incorrect / branches : 0.0);
+    smt_print_results();
+    smt_free();
+    free(paths);
+    return 0;
+  }
+  if (numPaths > 1) {
+    fprintf(stderr, "Several traces need --smt\n");
+    exit(1);
+  }
+  free(paths);
+
+  // Sweep mode only counts each lane's mispredictions
+  if (sweepLanes > 0 && (updateDelay >= 0 || intervalSize || verbose)) {
+    fprintf(stderr, "--sweep does not combine with --delay, --interval "
+                    "or --verbose\n");
+    exit(1);
+  }
+
+  if (!trace_open(&trace, path)) {
+    fprintf(stderr, "Cannot open trace %s\n", path ? path : "from stdin");
+    exit(1);
+  }
+  if ((windowStart || windowCount) &&
+      !trace_window(&trace, windowStart, windowCount)) {
+    fprintf(stderr, "Cannot seek to branch %llu\n", windowStart);
+    exit(1);
+  }
 
   uint32_t num_branches = 0;
   uint32_t mispredictions = 0;
   uint32_t pc = 0;
   uint8_t outcome = NOTTAKEN;
 
+  // Sweep mode steps every configured lane in lockstep instead
+  if (sweepLanes > 0) {
+    sweep_init();
+    while (read_branch(&pc, &outcome)) {
+      num_branches++;
+      sweep_step(pc, outcome, NULL);
+    }
+    sweep_print_results(num_branches);
+
+    sweep_free();
+    trace_close(&trace);
+    return 0;
+  }
+
+  // Initialize the predictor
+  init_predictor();
+  if (updateDelay >= 0 && !pipeline_init()) {
+    fprintf(stderr, "Cannot allocate %d in-flight branches\n", updateDelay);
+    exit(1);
+  }
+  if (intervalSize && !interval_init(windowStart)) {
+    fprintf(stderr, "Cannot open %s\n", intervalPath);
+    exit(1);
+  }
+
   // Reach each branch from the trace
   while (read_branch(&pc, &outcome)) {
     num_branches++;
 
-    // Make a prediction and compare with actual outcome
-    uint8_t prediction = make_prediction(pc);
+    // Make a prediction and compare with actual outcome.  The pipeline
+    // model trains the predictor itself once the branch leaves it
+    uint8_t prediction;
+    if (updateDelay >= 0) {
+      prediction = pipeline_step(pc, outcome);
+    } else {
+      prediction = make_prediction(pc);
+    }
     if (prediction != outcome) {
       mispredictions++;
     }
+    if (intervalSize && !interval_record(prediction != outcome, last_component())) {
+      exit(1);
+    }
     if (verbose != 0) {
       printf ("%d\n", prediction);
     }
 
     // Train the predictor
-    train_predictor(pc, outcome);
+    if (updateDelay < 0) {
+      train_predictor(pc, outcome);
+    }
   }
 
   // Print out the mispredict statistics
@@ -132,10 +323,17 @@ main(int argc, char *argv[])
   printf("Incorrect:       %10d\n", mispredictions);
   float mispredict_rate = 100*((float)mispredictions / (float)num_branches);
   printf("Misprediction Rate: %7.3f\n", mispredict_rate);
+  if (updateDelay >= 0) {
+    pipeline_drain();
+    pipeline_print_results();
+    pipeline_free();
+  }
+  if (intervalSize && !interval_finish()) {
+    exit(1);
+  }
 
   // Cleanup
-  fclose(stream);
-  free(buf);
+  trace_close(&trace);
 
   return 0;
 }
\ No newline at end of file
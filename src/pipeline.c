@@ -0,0 +1,87 @@
+//========================================================//
+//  pipeline.c                                            //
+//  Source file for the delayed-update pipeline model     //
+//                                                        //
+//  The trace only holds correct-path branches, so the    //
+//  history is repaired as soon as a misprediction is     //
+//  seen; younger wrong-path branches never exist here.   //
+//  Table updates still lag by the full delay, as they    //
+//  would when branches update at retirement.             //
+//========================================================//
+#include <stdio.h>
+#include <stdlib.h>
+#include "pipeline.h"
+
+int updateDelay = -1;
+
+//------------------------------------//
+//      Pipeline Model State          //
+//------------------------------------//
+
+typedef struct {
+    BranchState b;
+    uint8_t     outcome;
+} InFlight;
+
+static InFlight *queue = NULL;
+static uint32_t  queueCap;
+static uint32_t  head, count;
+
+static uint64_t repairs;
+
+//------------------------------------//
+//      Pipeline Model Functions      //
+//------------------------------------//
+
+static inline void pipeline_retire() {
+    InFlight *f = &queue[head];
+    update_predictor(&f->b, f->outcome);
+    head = (head + 1 == queueCap) ? 0 : head + 1;
+    count--;
+}
+
+int pipeline_init() {
+    if (updateDelay < 0 || updateDelay > PIPELINE_MAX_DELAY) {
+        return 0;
+    }
+    queueCap = updateDelay + 1;
+    queue = (InFlight *)malloc(queueCap * sizeof(InFlight));
+    head = count = 0;
+    repairs = 0;
+    return queue != NULL;
+}
+
+uint8_t pipeline_step(uint32_t pc, uint8_t outcome) {
+    uint32_t tail = head + count;
+    InFlight *f = &queue[tail >= queueCap ? tail - queueCap : tail];
+    count++;
+
+    uint8_t prediction = predict_branch(pc, &f->b);
+    f->outcome = outcome;
+    speculate_history(&f->b);
+    if (prediction != outcome) {
+        repair_history(&f->b, outcome);
+        repairs++;
+    }
+
+    if (count > (uint32_t)updateDelay) {
+        pipeline_retire();
+    }
+    return prediction;
+}
+
+void pipeline_drain() {
+    while (count > 0) {
+        pipeline_retire();
+    }
+}
+
+void pipeline_print_results() {
+    printf("Update delay:    %10d\n", updateDelay);
+    printf("History repairs: %10llu\n", (unsigned long long)repairs);
+}
+
+void pipeline_free() {
+    free(queue);
+    queue = NULL;
+}
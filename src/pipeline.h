@@ -0,0 +1,57 @@
+//========================================================//
+//  pipeline.h                                            //
+//  Header file for the delayed-update pipeline model     //
+//                                                        //
+//  Keeps a queue of in-flight branches so that table     //
+//  updates land several branches after the prediction,   //
+//  with global history updated speculatively             //
+//========================================================//
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdint.h>
+#include "predictor.h"
+
+//------------------------------------//
+//      Pipeline Model Defines        //
+//------------------------------------//
+#define PIPELINE_MAX_DELAY 4096
+
+// Branches predicted between a branch's prediction and its table update
+// (< 0 => train immediately, without the pipeline model)
+extern int updateDelay;
+
+//------------------------------------//
+//    Pipeline Model Prototypes       //
+//------------------------------------//
+
+// Allocate the in-flight queue.  The predictor must already be
+// initialized
+//
+// Returns True if Successful
+//
+int pipeline_init();
+
+// Predict the branch at PC 'pc' and put it in flight.  Global history is
+// updated with the prediction right away and repaired at once if it was
+// wrong.  The oldest branch updates the tables once more than
+// 'updateDelay' branches are in flight
+//
+// Returns the prediction
+//
+uint8_t pipeline_step(uint32_t pc, uint8_t outcome);
+
+// Update the tables with every branch still in flight
+//
+void pipeline_drain();
+
+// Print the update delay and history repair statistics
+//
+void pipeline_print_results();
+
+// Release the in-flight queue
+//
+void pipeline_free();
+
+#endif
@@ -7,8 +7,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
 #include "predictor.h"
+#include "rng.h"
 
 const char *studentName = "Param Somane";
 const char *studentID   = "A69033076";
@@ -22,11 +22,28 @@ const char *email       = "psomane@ucsd.edu";
 const char *bpName[4] = { "Static", "Gshare",
                           "Tournament", "Custom" };
 
+// Components a prediction can come from, per predictor type
+static const char *componentNames[4][NUM_COMPONENTS_MAX] = {
+    { "static" },
+    { "gshare" },
+    { "global", "local" },
+    { "bimodal", "bank0", "bank1", "bank2", "bank3", "bank4", "bank5", "bank6",
+      "loop", "sc" }
+};
+static const int componentCount[4] = { 1, 1, 2, 8 };
+#define LOOP_COMPONENT (1 + NUM_BANKS)
+#define SC_COMPONENT   (2 + NUM_BANKS)
+static int lastComponent; // component behind the last prediction
+
 int ghistoryBits; // Number of bits used for Global History
 int lhistoryBits; // Number of bits used for Local History
 int pcIndexBits;  // Number of bits used for PC index
 int bpType;       // Branch Prediction Type
 int verbose;
+int quiet;        // Suppress the memory usage / seed report
+uint64_t rngSeed = DEFAULT_RNG_SEED;
+int customLoop;   // Custom: add the loop predictor
+int customSC;     // Custom: add the statistical corrector
 
 //------------------------------------//
 //      Predictor Data Structures     //
@@ -51,18 +68,17 @@ static uint16_t *localPHT   = NULL;
 static uint8_t  *globalBHT  = NULL;
 static uint8_t  *choicePT   = NULL;
 static uint32_t globalhistory_t;
-static uint8_t  localOutcome;
-static uint8_t  globalOutcome;
 
 // ---- Custom (TAGE-like) data structures ----
 #define BIMODAL_SIZE 4099
+// With the statistical corrector the bimodal table gives up a quarter
+// of its entries, so that --custom:loop,sc fits the 64K + 256 bit budget
+#define BIMODAL_SIZE_SC 3025
 #define LEN_BIMODAL  2
 
-#define NUM_BANKS 7
 #define LEN_GLOBAL 9
 #define LEN_TAG    10
 #define LEN_COUNTS 3
-#define MAX_HISTORY_LEN 131
 
 static const uint8_t GEOMETRICS[NUM_BANKS] = {130, 76, 44, 26, 15, 9, 5};
 
@@ -91,6 +107,7 @@ static inline void updateSaturateMinMax(int8_t *saturate, int taken, int min, in
 }
 
 static int8_t t_bimodalPredictor[BIMODAL_SIZE];
+static int    t_bimodalSize; // entries in use
 
 typedef struct {
     int8_t   saturateCounter; // 3-bit
@@ -99,8 +116,8 @@ typedef struct {
 } BankEntry;
 
 typedef struct {
-    int8_t   geometryLength;
-    int8_t   targetLength;
+    uint8_t  geometryLength; // up to MAX_HISTORY_LEN - 1, past int8_t
+    uint8_t  targetLength;
     uint32_t compressed;
 } CompressedHistory;
 
@@ -114,32 +131,92 @@ typedef struct {
 static Bank    tageBank[NUM_BANKS];
 static uint8_t t_globalHistory[MAX_HISTORY_LEN];
 static uint32_t t_pathHistory;
-static uint8_t  primaryBank, alternateBank;
-static uint8_t  primaryPrediction, alternatePrediction;
-static uint8_t  lastPrediction;
 static int8_t   useAlternate;
-static uint32_t bankGlobalIndex[NUM_BANKS];
-static int      tagResult[NUM_BANKS];
+
+// Allocation RNG state (xorshift64*), owned by this predictor instance
+// instead of the shared, locked state behind rand()
+static uint64_t t_rngState;
+
+// ---- Custom loop predictor ----
+// Tracks the trip count of loop-closing branches and predicts the exit
+// once the same count has been seen LOOP_CONF_MAX times in a row
+#define LOOP_LOG_SETS  2
+#define LOOP_WAYS      4
+#define LOOP_ENTRIES   ((1 << LOOP_LOG_SETS) * LOOP_WAYS)
+#define LOOP_TAG_BITS  10
+#define LOOP_ITER_BITS 10
+#define LOOP_CONF_BITS 4
+#define LOOP_AGE_BITS  4
+#define LOOP_CONF_MAX  ((1 << LOOP_CONF_BITS) - 1)
+#define LOOP_AGE_MAX   ((1 << LOOP_AGE_BITS) - 1)
+#define LEN_USE_LOOP   7
+
+typedef struct {
+    uint16_t tag;
+    uint16_t pastIter;    // trip count of the last complete loop, 0 if unknown
+    uint16_t currentIter; // iterations retired in the current loop
+    uint16_t specIter;    // iterations fetched, advanced with the history
+    uint8_t  confidence;
+    uint8_t  age;         // replacement protection
+    uint8_t  dir;         // direction taken while the loop iterates
+} LoopEntry;
+
+static LoopEntry loopTable[LOOP_ENTRIES];
+static int8_t    useLoop; // >= 0 => trust confident loop entries over TAGE
+static uint8_t   loopTick; // TAGE mispredictions, paces allocation
+
+// ---- Custom statistical corrector ----
+// Sums signed counters from a bias table, indexed by the prediction it is
+// given, and from short global history tables.  A confident sum of the
+// opposite sign reverts the prediction.  The histories fit in one word,
+// folded at lookup instead of keeping a folded register per table
+#define SC_LOG_BIAS    8
+#define SC_LOG_TABLE   7
+#define LEN_SC_COUNTS  5
+#define SC_THRESHOLD_INIT 12
+#define LEN_SC_THRESHOLD_CTR 6
+
+static const uint8_t SC_GEOMETRICS[SC_NUM_TABLES] = {2, 6, 12, 27};
+
+static int8_t   scBias[1 << SC_LOG_BIAS];
+static int8_t   scTable[SC_NUM_TABLES][1 << SC_LOG_TABLE];
+static uint32_t scHistory; // last 32 outcomes, newest in bit 0
+static int    scThreshold;
+static int8_t scThresholdCtr;
+
+// ---- Predict-to-train state ----
+static BranchState current; // branch between make_prediction and train_predictor
+
+// Global histories as they were before the last speculate_history
+static HistoryState checkpoint;
 
 //------------------------------------//
 //    Predictor Function Declarations //
 //------------------------------------//
 
 // Gshare
-static inline uint8_t gshare_predict(uint32_t pc);
-static inline void     train_gshare(uint32_t pc, uint8_t outcome);
+static inline uint8_t gshare_predict(uint32_t pc, BranchState *b);
+static inline void     train_gshare(const BranchState *b, uint8_t outcome);
 
 // Tournament
 static void     tournament_init();
-static inline uint8_t get_local_prediction(uint32_t pc);
-static inline uint8_t get_global_prediction(uint32_t pc);
-static inline uint8_t get_tournament_prediction(uint32_t pc);
-static inline void     tournament_update(uint32_t pc, uint8_t outcome);
+static inline uint8_t get_local_prediction(uint32_t pc, BranchState *b);
+static inline uint8_t get_global_prediction(uint32_t pc, BranchState *b);
+static inline uint8_t get_tournament_prediction(uint32_t pc, BranchState *b);
+static inline void     tournament_update(const BranchState *b, uint8_t outcome);
 
 // Custom TAGE
 static void     tage_init();
-static inline uint8_t tage_predict(uint32_t pc);
-static inline void     tage_train(uint32_t pc, uint8_t outcome);
+static inline uint8_t tage_predict(uint32_t pc, BranchState *b);
+static inline void     tage_train(const BranchState *b, uint8_t outcome);
+static inline void     tage_update_history(uint32_t pc, uint8_t outcome);
+static inline uint8_t loop_predict(uint32_t pc, BranchState *b, uint8_t prediction);
+static inline void     loop_update(const BranchState *b, uint8_t outcome);
+static inline void     loop_speculate(const BranchState *b, uint8_t outcome);
+static inline uint8_t sc_predict(uint32_t pc, BranchState *b, uint8_t prediction);
+static inline void     sc_update(const BranchState *b, uint8_t outcome);
+
+static inline void update_history(const BranchState *b, uint8_t outcome);
 
 //------------------------------------//
 //        Memory Usage (Optional)     //
@@ -148,6 +225,7 @@ static inline void     tage_train(uint32_t pc, uint8_t outcome);
 static inline void print_memory_usage(void)
 {
     unsigned int bits_used = 0;
+    unsigned int loopBits = 0, scBits = 0;
     switch (bpType) {
         case STATIC: {
             bits_used = 0;
@@ -170,7 +248,7 @@ static inline void print_memory_usage(void)
         }
         case CUSTOM: {
             // Bimodal
-            bits_used += BIMODAL_SIZE * LEN_BIMODAL;
+            bits_used += (customSC ? BIMODAL_SIZE_SC : BIMODAL_SIZE) * LEN_BIMODAL;
             // TAGE banks
             for (int i = 0; i < NUM_BANKS; i++) {
                 bits_used += (1 << LEN_GLOBAL) * 15; // saturateCounter+tag+usefulness ~15 bits
@@ -182,6 +260,20 @@ static inline void print_memory_usage(void)
             bits_used += 4;  // useAlternate
             bits_used += NUM_BANKS * LEN_GLOBAL;
             bits_used += NUM_BANKS * LEN_TAG;
+            // Loop predictor: entries, use-loop and allocation counters
+            if (customLoop) {
+                loopBits = LOOP_ENTRIES * (LOOP_TAG_BITS + 3 * LOOP_ITER_BITS
+                                           + LOOP_CONF_BITS + LOOP_AGE_BITS + 1);
+                loopBits += LEN_USE_LOOP + 8;
+            }
+            // Statistical corrector: counters, folded histories, threshold
+            if (customSC) {
+                scBits  = (1 << SC_LOG_BIAS) * LEN_SC_COUNTS;
+                scBits += SC_NUM_TABLES * (1 << SC_LOG_TABLE) * LEN_SC_COUNTS;
+                scBits += 32; // history
+                scBits += 8 + LEN_SC_THRESHOLD_CTR;
+            }
+            bits_used += loopBits + scBits;
             break;
         }
         default: {
@@ -191,6 +283,12 @@ static inline void print_memory_usage(void)
     }
     fprintf(stdout, "Approx memory usage: %u bits (%.2f KB)\n",
             bits_used, (double)bits_used / 8192.0);
+    if (loopBits) {
+        fprintf(stdout, "  Loop predictor:        %u bits\n", loopBits);
+    }
+    if (scBits) {
+        fprintf(stdout, "  Statistical corrector: %u bits\n", scBits);
+    }
 }
 
 //------------------------------------//
@@ -226,51 +324,126 @@ void init_predictor() {
     }
 
     // Print usage info if desired
-    print_memory_usage();
+    if (!quiet) {
+        print_memory_usage();
+        if (bpType == CUSTOM) {
+            fprintf(stdout, "Random seed: %llu\n", (unsigned long long)rngSeed);
+        }
+    }
+}
+
+//--------------------------------------------------------
+// Component attribution
+//--------------------------------------------------------
+int num_components() {
+    if (bpType == CUSTOM && (customLoop || customSC)) {
+        return componentCount[CUSTOM] + 2;
+    }
+    return (bpType >= STATIC && bpType <= CUSTOM) ? componentCount[bpType] : 1;
+}
+
+const char *component_name(int c) {
+    return (bpType >= STATIC && bpType <= CUSTOM) ? componentNames[bpType][c] : "unknown";
+}
+
+int last_component() {
+    return (bpType == TOURNAMENT || bpType == CUSTOM) ? lastComponent : 0;
+}
+
+//--------------------------------------------------------
+// free_predictor
+//--------------------------------------------------------
+void free_predictor() {
+    free(bht_gshare);
+    free(localBHT);
+    free(localPHT);
+    free(globalBHT);
+    free(choicePT);
+    bht_gshare = NULL;
+    localBHT   = NULL;
+    localPHT   = NULL;
+    globalBHT  = NULL;
+    choicePT   = NULL;
 }
 
 //--------------------------------------------------------
 // make_prediction
 //--------------------------------------------------------
 uint8_t make_prediction(uint32_t pc) {
+    return predict_branch(pc, &current);
+}
+
+//--------------------------------------------------------
+// train_predictor
+//--------------------------------------------------------
+void train_predictor(uint32_t pc, uint8_t outcome) {
+    current.pc = pc;
+    update_predictor(&current, outcome);
+    update_history(&current, outcome);
+}
+
+//--------------------------------------------------------
+// predict_branch
+//--------------------------------------------------------
+uint8_t predict_branch(uint32_t pc, BranchState *b) {
+    b->pc = pc;
     switch (bpType) {
     case STATIC:
-        return TAKEN;  // always predict taken
+        b->prediction = TAKEN;  // always predict taken
+        break;
 
     case GSHARE:
-        return gshare_predict(pc);
+        b->prediction = gshare_predict(pc, b);
+        break;
 
     case TOURNAMENT:
-        return get_tournament_prediction(pc);
+        b->prediction = get_tournament_prediction(pc, b);
+        break;
 
     case CUSTOM:
-        return tage_predict(pc);
+        b->prediction = tage_predict(pc, b);
+        b->tagePrediction = b->prediction;
+        if (customLoop) {
+            b->prediction = loop_predict(pc, b, b->prediction);
+        }
+        if (customSC) {
+            b->prediction = sc_predict(pc, b, b->prediction);
+        }
+        break;
 
     default:
         // If there is not a compatable bpType then return NOTTAKEN
-        return NOTTAKEN;
+        b->prediction = NOTTAKEN;
+        break;
     }
+    return b->prediction;
 }
 
 //--------------------------------------------------------
-// train_predictor
+// update_predictor
 //--------------------------------------------------------
-void train_predictor(uint32_t pc, uint8_t outcome) {
+void update_predictor(const BranchState *b, uint8_t outcome) {
     switch (bpType) {
     case STATIC:
         // No training needed
         break;
 
     case GSHARE:
-        train_gshare(pc, outcome);
+        train_gshare(b, outcome);
         break;
 
     case TOURNAMENT:
-        tournament_update(pc, outcome);
+        tournament_update(b, outcome);
         break;
 
     case CUSTOM:
-        tage_train(pc, outcome);
+        tage_train(b, outcome);
+        if (customLoop) {
+            loop_update(b, outcome);
+        }
+        if (customSC) {
+            sc_update(b, outcome);
+        }
         break;
 
     default:
@@ -279,21 +452,105 @@ void train_predictor(uint32_t pc, uint8_t outcome) {
     }
 }
 
+//--------------------------------------------------------
+// Global history
+//--------------------------------------------------------
+static inline void update_history(const BranchState *b, uint8_t outcome) {
+    switch (bpType) {
+    case GSHARE:
+        ghistory_g = ((ghistory_g << 1) | outcome) & ((1 << ghistoryBits) - 1);
+        break;
+
+    case TOURNAMENT:
+        globalhistory_t = ((globalhistory_t << 1) | outcome) & ((1 << ghistoryBits) - 1);
+        break;
+
+    case CUSTOM:
+        tage_update_history(b->pc, outcome);
+        if (customLoop) {
+            loop_speculate(b, outcome);
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+void save_history(HistoryState *h) {
+    switch (bpType) {
+    case GSHARE:
+        h->ghistory_g = ghistory_g;
+        break;
+
+    case TOURNAMENT:
+        h->globalhistory_t = globalhistory_t;
+        break;
+
+    case CUSTOM:
+        memcpy(h->t_globalHistory, t_globalHistory, sizeof(t_globalHistory));
+        h->t_pathHistory = t_pathHistory;
+        for (int i = 0; i < NUM_BANKS; i++) {
+            h->compressed[i][0] = tageBank[i].indexCompressed.compressed;
+            h->compressed[i][1] = tageBank[i].tagCompressed[0].compressed;
+            h->compressed[i][2] = tageBank[i].tagCompressed[1].compressed;
+        }
+        h->scHistory = scHistory;
+        break;
+
+    default:
+        break;
+    }
+}
+
+void restore_history(const HistoryState *h) {
+    switch (bpType) {
+    case GSHARE:
+        ghistory_g = h->ghistory_g;
+        break;
+
+    case TOURNAMENT:
+        globalhistory_t = h->globalhistory_t;
+        break;
+
+    case CUSTOM:
+        memcpy(t_globalHistory, h->t_globalHistory, sizeof(t_globalHistory));
+        t_pathHistory = h->t_pathHistory;
+        for (int i = 0; i < NUM_BANKS; i++) {
+            tageBank[i].indexCompressed.compressed  = h->compressed[i][0];
+            tageBank[i].tagCompressed[0].compressed = h->compressed[i][1];
+            tageBank[i].tagCompressed[1].compressed = h->compressed[i][2];
+        }
+        scHistory = h->scHistory;
+        break;
+
+    default:
+        break;
+    }
+}
+
+void speculate_history(const BranchState *b) {
+    save_history(&checkpoint);
+    update_history(b, b->prediction);
+}
+
+void repair_history(const BranchState *b, uint8_t outcome) {
+    restore_history(&checkpoint);
+    update_history(b, outcome);
+}
+
 //--------------------------------------------------------
 // GSHARE Implementation
 //--------------------------------------------------------
-static inline uint8_t gshare_predict(uint32_t pc) {
+static inline uint8_t gshare_predict(uint32_t pc, BranchState *b) {
     uint32_t mask  = (1 << ghistoryBits) - 1;
-    uint32_t index = ((pc & mask) ^ (ghistory_g & mask));
-    uint8_t  state = bht_gshare[index];
+    b->globalIndex = ((pc & mask) ^ (ghistory_g & mask));
+    uint8_t  state = bht_gshare[b->globalIndex];
     return (state == SN || state == WN) ? NOTTAKEN : TAKEN;
 }
 
-static inline void train_gshare(uint32_t pc, uint8_t outcome) {
-    uint32_t mask  = (1 << ghistoryBits) - 1;
-    uint32_t index = ((pc & mask) ^ (ghistory_g & mask));
-    shift_prediction(&bht_gshare[index], outcome);
-    ghistory_g = ((ghistory_g << 1) | outcome) & mask;
+static inline void train_gshare(const BranchState *b, uint8_t outcome) {
+    shift_prediction(&bht_gshare[b->globalIndex], outcome);
 }
 
 //--------------------------------------------------------
@@ -315,74 +572,74 @@ static void tournament_init() {
     globalhistory_t = 0;
 }
 
-static inline uint8_t get_local_prediction(uint32_t pc) {
+static inline uint8_t get_local_prediction(uint32_t pc, BranchState *b) {
     uint32_t phtIndex = pc & ((1 << pcIndexBits) - 1);
     uint16_t lhist    = localPHT[phtIndex] & ((1 << lhistoryBits) - 1);
     uint8_t  lPred    = localBHT[lhist];
-    localOutcome      = (lPred == SN || lPred == WN) ? NOTTAKEN : TAKEN;
-    return localOutcome;
+    b->localIndex     = lhist;
+    b->localOutcome   = (lPred == SN || lPred == WN) ? NOTTAKEN : TAKEN;
+    return b->localOutcome;
 }
 
-static inline uint8_t get_global_prediction(uint32_t pc) {
+static inline uint8_t get_global_prediction(uint32_t pc, BranchState *b) {
     (void)pc;
     uint32_t mask = (1 << ghistoryBits) - 1;
     uint32_t gIdx = globalhistory_t & mask;
     uint8_t  gPred = globalBHT[gIdx];
-    globalOutcome  = (gPred == SN || gPred == WN) ? NOTTAKEN : TAKEN;
-    return globalOutcome;
+    b->globalIndex   = gIdx;
+    b->globalOutcome = (gPred == SN || gPred == WN) ? NOTTAKEN : TAKEN;
+    return b->globalOutcome;
 }
 
-static inline uint8_t get_tournament_prediction(uint32_t pc) {
+static inline uint8_t get_tournament_prediction(uint32_t pc, BranchState *b) {
     uint32_t mask   = (1 << ghistoryBits) - 1;
     uint32_t cIndex = globalhistory_t & mask;
     uint8_t  choice = choicePT[cIndex];
 
-    get_global_prediction(pc);
-    get_local_prediction(pc);
+    get_global_prediction(pc, b);
+    get_local_prediction(pc, b);
 
     if (choice == SN || choice == WN) {
-        return globalOutcome;
+        lastComponent = 0;
+        return b->globalOutcome;
     } else {
-        return localOutcome;
+        lastComponent = 1;
+        return b->localOutcome;
     }
 }
 
-static inline void tournament_update(uint32_t pc, uint8_t outcome) {
-    uint32_t mask   = (1 << ghistoryBits) - 1;
-    uint32_t cIndex = globalhistory_t & mask;
+static inline void tournament_update(const BranchState *b, uint8_t outcome) {
+    // Choice and global counters share the index taken at predict time
+    uint32_t cIndex = b->globalIndex;
 
     // Update choice if localOutcome != globalOutcome
-    if (localOutcome != globalOutcome) {
-        if (localOutcome == outcome) {
+    if (b->localOutcome != b->globalOutcome) {
+        if (b->localOutcome == outcome) {
             shift_prediction(&choicePT[cIndex], TAKEN);
-        } else if (globalOutcome == outcome) {
+        } else if (b->globalOutcome == outcome) {
             shift_prediction(&choicePT[cIndex], NOTTAKEN);
         }
     }
 
-    // Update local predictor
-    uint32_t phtIndex = pc & ((1 << pcIndexBits) - 1);
-    uint16_t lhist    = localPHT[phtIndex] & ((1 << lhistoryBits) - 1);
-    shift_prediction(&localBHT[lhist], outcome);
+    // Update local predictor, through the history it predicted with
+    shift_prediction(&localBHT[b->localIndex], outcome);
 
+    uint32_t phtIndex = b->pc & ((1 << pcIndexBits) - 1);
+    uint16_t lhist    = localPHT[phtIndex];
     lhist <<= 1;
     lhist  &= (1 << lhistoryBits) - 1;
     lhist  |= outcome;
     localPHT[phtIndex] = lhist;
 
     // Update global predictor
-    uint32_t gIdx = globalhistory_t & mask;
-    shift_prediction(&globalBHT[gIdx], outcome);
-
-    // Update global history
-    globalhistory_t = ((globalhistory_t << 1) | outcome) & mask;
+    shift_prediction(&globalBHT[b->globalIndex], outcome);
 }
 
 //--------------------------------------------------------
 // CUSTOM (TAGE) Implementation
 //--------------------------------------------------------
 static inline uint8_t t_getBimodalPrediction(uint32_t pc) {
-    int idx = pc % BIMODAL_SIZE;
+    int idx = pc % t_bimodalSize;
     int8_t val = t_bimodalPredictor[idx];
     // LEN_BIMODAL=2 => range is 0..3 => >=2 => TAKEN
     return (val >= (1 << (LEN_BIMODAL - 1))) ? TAKEN : NOTTAKEN;
@@ -435,6 +692,7 @@ static inline uint32_t getGlobalIndex(uint32_t pc, int bankIdx) {
 
 static void tage_init() {
     // Bimodal
+    t_bimodalSize = customSC ? BIMODAL_SIZE_SC : BIMODAL_SIZE;
     for (int i = 0; i < BIMODAL_SIZE; i++) {
         // let’s default to "weakly taken" => 1
         t_bimodalPredictor[i] = (1 << (LEN_BIMODAL - 1)) - 1;
@@ -466,20 +724,36 @@ static void tage_init() {
     memset(t_globalHistory, 0, sizeof(t_globalHistory));
     t_pathHistory = 0;
     useAlternate  = 8;
-    primaryBank = alternateBank = NUM_BANKS;
-    primaryPrediction = alternatePrediction = lastPrediction = NOTTAKEN;
 
-    srand((unsigned int)time(NULL));
+    // Loop predictor
+    memset(loopTable, 0, sizeof(loopTable));
+    useLoop  = -1;
+    loopTick = 0;
+
+    // Statistical corrector: bias entries start out agreeing with the
+    // prediction they are indexed by
+    for (int i = 0; i < (1 << SC_LOG_BIAS); i++) {
+        scBias[i] = (i & 2) ? 0 : -1;
+    }
+    memset(scTable, 0, sizeof(scTable));
+    scHistory = 0;
+    scThreshold    = SC_THRESHOLD_INIT;
+    scThresholdCtr = 0;
+
+    rng_seed(&t_rngState, rngSeed, RNG_STREAM_TAGE);
 }
 
-static inline uint8_t tage_predict(uint32_t pc) {
+static inline uint8_t tage_predict(uint32_t pc, BranchState *b) {
+    uint16_t *bankGlobalIndex = b->bankIndex;
+    uint16_t *tagResult       = b->bankTag;
     for (int i = 0; i < NUM_BANKS; i++) {
         tagResult[i]       = generateGlobalEntryTag(pc, i);
         bankGlobalIndex[i] = getGlobalIndex(pc, i);
     }
 
-    primaryBank   = NUM_BANKS;
-    alternateBank = NUM_BANKS;
+    uint8_t primaryBank   = NUM_BANKS;
+    uint8_t alternateBank = NUM_BANKS;
+    uint8_t alternatePrediction, lastPrediction;
 
     for (int i = 0; i < NUM_BANKS; i++) {
         if (tageBank[i].entry[ bankGlobalIndex[i] ].tag == tagResult[i]) {
@@ -505,19 +779,33 @@ static inline uint8_t tage_predict(uint32_t pc) {
         int8_t pU   = tageBank[primaryBank].entry[ bankGlobalIndex[primaryBank] ].usefulness;
         if ((pCtr != 0 && pCtr != -1) || (pU != 0) || (useAlternate < 8)) {
             lastPrediction = (pCtr >= 0) ? TAKEN : NOTTAKEN;
+            lastComponent  = 1 + primaryBank;
         } else {
             lastPrediction = alternatePrediction;
+            lastComponent  = (alternateBank < NUM_BANKS) ? 1 + alternateBank : 0;
         }
+        b->tageWeak = (pCtr == 0 || pCtr == -1);
     } else {
         // fallback to bimodal
         alternatePrediction = t_getBimodalPrediction(pc);
         lastPrediction      = alternatePrediction;
+        lastComponent       = 0;
+        int8_t bCtr = t_bimodalPredictor[pc % t_bimodalSize];
+        b->tageWeak = (bCtr == WN || bCtr == WT);
     }
 
+    b->primaryBank         = primaryBank;
+    b->alternateBank       = alternateBank;
+    b->alternatePrediction = alternatePrediction;
     return lastPrediction;
 }
 
-static inline void tage_train(uint32_t pc, uint8_t outcome) {
+static inline void tage_train(const BranchState *b, uint8_t outcome) {
+    const uint16_t *bankGlobalIndex = b->bankIndex;
+    uint8_t primaryBank         = b->primaryBank;
+    uint8_t alternatePrediction = b->alternatePrediction;
+    uint8_t lastPrediction      = b->tagePrediction;
+
     // 1. Determine whether we need to allocate a new entry in the TAGE tables (i.e., whether
     //    the prediction was mispredicted and we have reason to believe a new entry could
     //    improve future prediction accuracy).
@@ -571,7 +859,7 @@ static inline void tage_train(uint32_t pc, uint8_t outcome) {
             // Y is used here to randomly select which bank (among the possible ones) gets the new entry.
             // The expression "(1 << (primaryBank - 1)) - 1" essentially creates a bitmask.
             // For example, if primaryBank = 3, we get (1 << 2) - 1 = 3 (binary 11).
-            int Y = rand() & ((1 << (primaryBank - 1)) - 1);
+            int Y = (int)(rng_next(&t_rngState) & ((1 << (primaryBank - 1)) - 1));
             int X = primaryBank - 1;
 
             // This loop steps backward through the banks (less selective to more selective) until it
@@ -588,7 +876,7 @@ static inline void tage_train(uint32_t pc, uint8_t outcome) {
             for (int i = X; i >= 0; i--) {
                 if (tageBank[i].entry[ bankGlobalIndex[i] ].usefulness == minUse) {
                     // Re-initialize the entry with the new tag and starting counter value.
-                    tageBank[i].entry[ bankGlobalIndex[i] ].tag = generateGlobalEntryTag(pc, i);
+                    tageBank[i].entry[ bankGlobalIndex[i] ].tag = b->bankTag[i];
                     tageBank[i].entry[ bankGlobalIndex[i] ].saturateCounter =
                         (outcome == TAKEN) ? 0 : -1;
                     tageBank[i].entry[ bankGlobalIndex[i] ].usefulness = 0;
@@ -608,7 +896,7 @@ static inline void tage_train(uint32_t pc, uint8_t outcome) {
         );
     } else {
         // If the prediction came from the bimodal predictor, update it instead.
-        int idx = pc % BIMODAL_SIZE;
+        int idx = b->pc % t_bimodalSize;
         updateSaturateMinMax(&t_bimodalPredictor[idx], outcome, 0, (1 << LEN_BIMODAL) - 1);
     }
 
@@ -624,7 +912,9 @@ static inline void tage_train(uint32_t pc, uint8_t outcome) {
             );
         }
     }
+}
 
+static inline void tage_update_history(uint32_t pc, uint8_t outcome) {
     // 5. Update the global history with the new outcome. This shifts the array t_globalHistory
     //    and inserts the latest taken/not-taken result at the front (index 0).
     for (int i = MAX_HISTORY_LEN - 1; i > 0; i--) {
@@ -644,4 +934,195 @@ static inline void tage_train(uint32_t pc, uint8_t outcome) {
         t_updateCompressed(&tageBank[i].tagCompressed[0], t_globalHistory);
         t_updateCompressed(&tageBank[i].tagCompressed[1], t_globalHistory);
     }
+    if (customSC) {
+        scHistory = (scHistory << 1) | t_globalHistory[0];
+    }
+}
+
+//--------------------------------------------------------
+// CUSTOM Loop Predictor
+//--------------------------------------------------------
+static inline uint16_t loop_tag(uint32_t pc) {
+    return (pc >> LOOP_LOG_SETS) & ((1 << LOOP_TAG_BITS) - 1);
+}
+
+static inline uint8_t loop_predict(uint32_t pc, BranchState *b, uint8_t prediction) {
+    uint32_t set = pc & ((1 << LOOP_LOG_SETS) - 1);
+    uint16_t tag = loop_tag(pc);
+
+    b->loopSlot  = LOOP_ENTRIES;
+    b->loopValid = 0;
+    for (int w = 0; w < LOOP_WAYS; w++) {
+        const LoopEntry *e = &loopTable[set * LOOP_WAYS + w];
+        if (e->tag == tag && e->age > 0) {
+            b->loopSlot       = set * LOOP_WAYS + w;
+            b->loopIter       = e->specIter;
+            b->loopDir        = e->dir;
+            b->loopPrediction = (e->specIter + 1 == e->pastIter) ? !e->dir : e->dir;
+            b->loopValid      = (e->confidence == LOOP_CONF_MAX);
+            break;
+        }
+    }
+
+    if (b->loopValid && useLoop >= 0) {
+        lastComponent = LOOP_COMPONENT;
+        return b->loopPrediction;
+    }
+    return prediction;
+}
+
+static inline void loop_update(const BranchState *b, uint8_t outcome) {
+    if (b->loopSlot == LOOP_ENTRIES) {
+        // Allocate on a TAGE misprediction, most often the exit of a loop
+        // TAGE has not learnt, so the entry iterates the other way.  The
+        // throttle and victim come from a counter of TAGE mispredictions
+        // rather than the allocation RNG, which stays TAGE's own
+        if (b->tagePrediction == outcome || (++loopTick & 3) != 0) {
+            return;
+        }
+        // Another in-flight instance may have allocated the branch since
+        // it was predicted: never hold it twice, and reuse a freed entry
+        uint32_t set = b->pc & ((1 << LOOP_LOG_SETS) - 1);
+        LoopEntry *e = NULL;
+        for (int w = 0; w < LOOP_WAYS; w++) {
+            if (loopTable[set * LOOP_WAYS + w].tag == loop_tag(b->pc)) {
+                e = &loopTable[set * LOOP_WAYS + w];
+                break;
+            }
+        }
+        if (e && e->age > 0) {
+            return;
+        }
+        if (!e) {
+            e = &loopTable[set * LOOP_WAYS + ((loopTick >> 2) & (LOOP_WAYS - 1))];
+            if (e->age > 0) {
+                e->age--;
+                return;
+            }
+        }
+        e->tag         = loop_tag(b->pc);
+        e->dir         = !outcome;
+        e->pastIter    = 0;
+        e->currentIter = 0;
+        e->specIter    = 0;
+        e->confidence  = 0;
+        e->age         = LOOP_AGE_MAX / 2;
+        return;
+    }
+
+    // Under --delay the entry may have gone to another branch since
+    LoopEntry *e = &loopTable[b->loopSlot];
+    if (e->tag != loop_tag(b->pc)) {
+        return;
+    }
+    if (b->loopValid) {
+        if (b->loopPrediction != b->tagePrediction) {
+            updateSaturate(&useLoop, b->loopPrediction == outcome, LEN_USE_LOOP);
+        }
+        if (b->loopPrediction != outcome) {
+            // Trip count changed: free the entry
+            e->pastIter    = 0;
+            e->currentIter = 0;
+            e->confidence  = 0;
+            e->age         = 0;
+            return;
+        }
+        if (b->loopPrediction != b->tagePrediction && e->age < LOOP_AGE_MAX) {
+            e->age++;
+        }
+    }
+
+    e->currentIter = (e->currentIter + 1) & ((1 << LOOP_ITER_BITS) - 1);
+    if (e->currentIter > e->pastIter && e->pastIter != 0) {
+        // Ran past the known trip count: learn it again
+        e->pastIter   = 0;
+        e->confidence = 0;
+    }
+    if (outcome != e->dir) {
+        if (e->currentIter == e->pastIter) {
+            if (e->confidence < LOOP_CONF_MAX) {
+                e->confidence++;
+            }
+            if (e->pastIter < 3) {
+                // Too short to be worth predicting: flip and start over
+                e->dir        = outcome;
+                e->pastIter   = 0;
+                e->confidence = 0;
+            }
+        } else if (e->pastIter == 0) {
+            e->pastIter   = e->currentIter;
+            e->confidence = 0;
+        } else {
+            e->pastIter   = 0;
+            e->confidence = 0;
+        }
+        e->currentIter = 0;
+    }
+}
+
+// Step the fetched iteration count of the branch's entry as its
+// outcome enters the history.  The count is rebuilt from the value read
+// at predict time, so a repair simply overwrites the speculative step
+static inline void loop_speculate(const BranchState *b, uint8_t outcome) {
+    if (b->loopSlot == LOOP_ENTRIES || loopTable[b->loopSlot].tag != loop_tag(b->pc)) {
+        return;
+    }
+    loopTable[b->loopSlot].specIter =
+        (outcome == b->loopDir) ? (b->loopIter + 1) & ((1 << LOOP_ITER_BITS) - 1) : 0;
+}
+
+//--------------------------------------------------------
+// CUSTOM Statistical Corrector
+//--------------------------------------------------------
+static inline uint8_t sc_predict(uint32_t pc, BranchState *b, uint8_t prediction) {
+    uint16_t *idx = b->scIndex;
+    idx[0] = ((pc << 2) | (prediction << 1) | b->tageWeak) & ((1 << SC_LOG_BIAS) - 1);
+    int sum = 2 * scBias[idx[0]] + 1;
+    for (int i = 0; i < SC_NUM_TABLES; i++) {
+        uint32_t h = scHistory & ((1u << SC_GEOMETRICS[i]) - 1);
+        h ^= (h >> SC_LOG_TABLE) ^ (h >> (2 * SC_LOG_TABLE)) ^ (h >> (3 * SC_LOG_TABLE));
+        idx[1 + i] = (pc ^ (pc >> (SC_LOG_TABLE - i)) ^ h) & ((1 << SC_LOG_TABLE) - 1);
+        sum += 2 * scTable[i][idx[1 + i]] + 1;
+    }
+
+    b->scSum   = (int16_t)sum;
+    b->scInput = prediction;
+    if ((sum >= 0) != prediction && abs(sum) >= scThreshold) {
+        lastComponent = SC_COMPONENT;
+        return !prediction;
+    }
+    return prediction;
+}
+
+static inline void sc_update(const BranchState *b, uint8_t outcome) {
+    int sum = b->scSum;
+    uint8_t scPrediction = (sum >= 0);
+
+    // Adapt the threshold on the sums that disagree with the incoming
+    // prediction and sit close to it: raise it while such sums are wrong,
+    // lower it while they are right
+    if (scPrediction != b->scInput && abs(sum) < 2 * scThreshold) {
+        if (scPrediction != outcome) {
+            updateSaturate(&scThresholdCtr, TAKEN, LEN_SC_THRESHOLD_CTR);
+            if (scThresholdCtr == (1 << (LEN_SC_THRESHOLD_CTR - 1)) - 1) {
+                scThreshold++;
+                scThresholdCtr = 0;
+            }
+        } else {
+            updateSaturate(&scThresholdCtr, NOTTAKEN, LEN_SC_THRESHOLD_CTR);
+            if (scThresholdCtr == -(1 << (LEN_SC_THRESHOLD_CTR - 1))) {
+                if (scThreshold > 1) {
+                    scThreshold--;
+                }
+                scThresholdCtr = 0;
+            }
+        }
+    }
+
+    if (scPrediction != outcome || abs(sum) < scThreshold) {
+        updateSaturate(&scBias[b->scIndex[0]], outcome, LEN_SC_COUNTS);
+        for (int i = 0; i < SC_NUM_TABLES; i++) {
+            updateSaturate(&scTable[i][b->scIndex[1 + i]], outcome, LEN_SC_COUNTS);
+        }
+    }
 }
@@ -32,6 +32,19 @@ extern const char *email;
 #define CUSTOM      3
 extern const char *bpName[];
 
+// Tagged banks of the custom (TAGE-like) predictor
+#define NUM_BANKS 7
+
+// History tables of the custom predictor's statistical corrector
+#define SC_NUM_TABLES 4
+
+// Longest global history of the custom predictor
+#define MAX_HISTORY_LEN 131
+
+// Most components any predictor type attributes predictions to
+// (custom: bimodal, the banks, loop predictor, statistical corrector)
+#define NUM_COMPONENTS_MAX (1 + NUM_BANKS + 2)
+
 // Definitions for 2-bit counters
 #define SN  0			// predict NT, strong not taken
 #define WN  1			// predict NT, weak not taken
@@ -46,6 +59,54 @@ extern int lhistoryBits; // Number of bits used for Local History
 extern int pcIndexBits;  // Number of bits used for PC index
 extern int bpType;       // Branch Prediction Type
 extern int verbose;
+extern int quiet;        // Suppress the memory usage / seed report
+extern uint64_t rngSeed; // Seed of the custom predictor's allocation RNG
+extern int customLoop;   // Custom: add the loop predictor
+extern int customSC;     // Custom: add the statistical corrector
+
+#define DEFAULT_RNG_SEED 1
+
+// Predict-time state of one branch: everything the table update needs
+// besides the outcome.  make_prediction keeps a single internal copy,
+// the pipeline model keeps one per in-flight branch
+typedef struct {
+    uint32_t pc;
+    uint8_t  prediction;
+    // Gshare / Tournament
+    uint32_t globalIndex;  // gshare counter, tournament global/choice entry
+    uint32_t localIndex;   // tournament local history read at predict time
+    uint8_t  localOutcome;
+    uint8_t  globalOutcome;
+    // Custom
+    uint8_t  primaryBank;
+    uint8_t  alternateBank;
+    uint8_t  alternatePrediction;
+    uint16_t bankIndex[NUM_BANKS];
+    uint16_t bankTag[NUM_BANKS];
+    uint8_t  tagePrediction;  // before the loop predictor / corrector
+    uint8_t  tageWeak;        // provider counter was weak
+    // Custom loop predictor / statistical corrector
+    uint8_t  loopSlot;        // matching entry, LOOP_ENTRIES if none
+    uint8_t  loopPrediction;
+    uint8_t  loopValid;       // entry confident enough to predict
+    uint16_t loopIter;        // entry's fetched iterations before this one
+    uint8_t  loopDir;
+    int16_t  scSum;
+    uint8_t  scInput;         // prediction the corrector was given
+    uint16_t scIndex[1 + SC_NUM_TABLES];
+} BranchState;
+
+// Global history of every predictor type, as kept by speculate_history
+// and by each hardware context that does not share history.  A zeroed
+// record is the history init_predictor starts from
+typedef struct {
+    uint32_t ghistory_g;
+    uint32_t globalhistory_t;
+    uint8_t  t_globalHistory[MAX_HISTORY_LEN];
+    uint32_t t_pathHistory;
+    uint32_t compressed[NUM_BANKS][3];
+    uint32_t scHistory;
+} HistoryState;
 
 //------------------------------------//
 //    Predictor Function Prototypes   //
@@ -67,4 +128,41 @@ uint8_t make_prediction(uint32_t pc);
 //
 void train_predictor(uint32_t pc, uint8_t outcome);
 
+// Split interface for modelling update latency.  predict_branch makes a
+// prediction without changing any state and records what the update
+// needs in 'b'; update_predictor later trains the tables from 'b'.
+// Global history is pushed separately: speculate_history checkpoints it
+// and shifts in b->prediction, repair_history rolls back to the
+// checkpoint and shifts in the real outcome.  Only the youngest branch
+// can be repaired
+//
+uint8_t predict_branch(uint32_t pc, BranchState *b);
+void update_predictor(const BranchState *b, uint8_t outcome);
+void speculate_history(const BranchState *b);
+void repair_history(const BranchState *b, uint8_t outcome);
+
+// Copy the global history of the current predictor type out to 'h', or
+// replace it with 'h'.  The tables are not touched, so contexts that
+// swap their history in and out still share them
+//
+void save_history(HistoryState *h);
+void restore_history(const HistoryState *h);
+
+// Number and names of the components the current predictor type can
+// take a prediction from (e.g. tournament: global, local; custom:
+// bimodal, each tagged bank, and the loop predictor and statistical
+// corrector when enabled)
+//
+int num_components();
+const char *component_name(int c);
+
+// Component that provided the last prediction
+//
+int last_component();
+
+// Release the tables allocated by init_predictor so that the predictor
+// can be initialized again
+//
+void free_predictor();
+
 #endif
\ No newline at end of file
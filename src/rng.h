@@ -0,0 +1,55 @@
+//========================================================//
+//  rng.h                                                 //
+//  Header file for the seedable random number generators //
+//                                                        //
+//  xorshift64* streams seeded through splitmix64.  The   //
+//  state lives with each user, and every user draws from //
+//  its own stream of the one --seed                      //
+//========================================================//
+
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+//------------------------------------//
+//            RNG Streams             //
+//------------------------------------//
+
+#define RNG_STREAM_TAGE       0 // custom predictor's bank allocation
+#define RNG_STREAM_SMT_FETCH  1 // SMT random fetch policy
+
+//------------------------------------//
+//           RNG Functions            //
+//------------------------------------//
+
+// Advance the splitmix64 counter 'state' and return its mixed value
+//
+static inline uint64_t splitmix64(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Seed the xorshift64* 'state' from 'seed' for stream 'stream'.  The
+// stream number is spread over the seed before the splitmix64 step, so
+// streams of the same seed start from unrelated states, and small seeds
+// still give a well mixed state
+//
+static inline void rng_seed(uint64_t *state, uint64_t seed, uint64_t stream) {
+    uint64_t x = seed ^ (stream * 0xD1B54A32D192ED03ULL);
+    uint64_t z = splitmix64(&x);
+    *state = z ? z : 0x9E3779B97F4A7C15ULL;
+}
+
+// Next 32-bit value of the xorshift64* 'state'
+//
+static inline uint32_t rng_next(uint64_t *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return (uint32_t)((*state * 0x2545F4914F6CDD1DULL) >> 33);
+}
+
+#endif
@@ -15,19 +15,31 @@ echo "Extended Branch Predictor Experiments" > $EXTENDED_RESULTS
 echo "======================================" >> $EXTENDED_RESULTS
 
 # 3) Parameter sweeps
+# Runs read the traces with --cache so each trace is decompressed once and
+# every later run maps the decoded copy from /dev/shm instead.
 
 # Sweep gshare from history=8..16
+# All nine widths are simulated in lockstep by a single --sweep run per
+# trace; the per-width blocks are then regrouped by configuration.
+SWEEP_DIR=$(mktemp -d)
+for trace in int_1 int_2 fp_1 fp_2 mm_1 mm_2
+do
+  ./predictor --cache --sweep:gshare:8-16 ../traces/${trace}.bz2 > ${SWEEP_DIR}/${trace}
+done
 for ghist_bits in 8 9 10 11 12 13 14 15 16
 do
   echo "GSHARE - ghistoryBits=${ghist_bits}" >> $EXTENDED_RESULTS
   for trace in int_1 int_2 fp_1 fp_2 mm_1 mm_2
   do
     echo "Trace: ${trace}" >> $EXTENDED_RESULTS
-    bunzip2 -c ../traces/${trace}.bz2 | ./predictor --gshare:${ghist_bits} >> $EXTENDED_RESULTS
+    awk -v lane="[GSHARE:${ghist_bits}]" \
+        '$1 == lane { keep = 1; next } /^ *\[/ { keep = 0 } keep' \
+        ${SWEEP_DIR}/${trace} >> $EXTENDED_RESULTS
     echo "------" >> $EXTENDED_RESULTS
   done
   echo "======" >> $EXTENDED_RESULTS
 done
+rm -rf ${SWEEP_DIR}
 
 # Sweep some Tournament combos
 for GH in 9 10 11 12 13 14; do
@@ -37,7 +49,7 @@ for GH in 9 10 11 12 13 14; do
      for trace in int_1 int_2 fp_1 fp_2 mm_1 mm_2
      do
        echo "Trace: ${trace}" >> $EXTENDED_RESULTS
-       bunzip2 -c ../traces/${trace}.bz2 | ./predictor --tournament:${GH}:${LH}:${PC} >> $EXTENDED_RESULTS
+       ./predictor --cache --tournament:${GH}:${LH}:${PC} ../traces/${trace}.bz2 >> $EXTENDED_RESULTS
        echo "------" >> $EXTENDED_RESULTS
      done
      echo "======" >> $EXTENDED_RESULTS
@@ -50,7 +62,7 @@ echo "CUSTOM TAGE tests..." >> $EXTENDED_RESULTS
 for trace in int_1 int_2 fp_1 fp_2 mm_1 mm_2
 do
  echo "Trace: ${trace}" >> $EXTENDED_RESULTS
- bunzip2 -c ../traces/${trace}.bz2 | ./predictor --custom >> $EXTENDED_RESULTS
+ ./predictor --cache --custom ../traces/${trace}.bz2 >> $EXTENDED_RESULTS
  echo "------" >> $EXTENDED_RESULTS
 done
 echo "======" >> $EXTENDED_RESULTS
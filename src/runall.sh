@@ -13,26 +13,31 @@ echo "Branch Predictor Results" > results.txt
 echo "========================" >> results.txt
 
 # 3) For each of the 6 traces, run:
-#    static, gshare, tournament, custom
+#    static, gshare, tournament, custom, custom:loop,sc
+#    (--cache decodes each trace once and shares it through /dev/shm)
 for trace in int_1 int_2 fp_1 fp_2 mm_1 mm_2
 do
   echo "${trace}:" >> results.txt
 
   # 3a) STATIC
   echo "  [STATIC]" >> results.txt
-  bunzip2 -c ../traces/${trace}.bz2 | ./predictor --static >> results.txt
+  ./predictor --cache --static ../traces/${trace}.bz2 >> results.txt
 
   # 3b) GSHARE
   echo "  [GSHARE:13]" >> results.txt
-  bunzip2 -c ../traces/${trace}.bz2 | ./predictor --gshare:13 >> results.txt
+  ./predictor --cache --gshare:13 ../traces/${trace}.bz2 >> results.txt
 
   # 3c) TOURNAMENT
   echo "  [TOURNAMENT:9:10:10]" >> results.txt
-  bunzip2 -c ../traces/${trace}.bz2 | ./predictor --tournament:9:10:10 >> results.txt
+  ./predictor --cache --tournament:9:10:10 ../traces/${trace}.bz2 >> results.txt
 
   # 3d) CUSTOM
   echo "  [CUSTOM]" >> results.txt
-  bunzip2 -c ../traces/${trace}.bz2 | ./predictor --custom >> results.txt
+  ./predictor --cache --custom ../traces/${trace}.bz2 >> results.txt
+
+  # 3e) CUSTOM with the loop predictor and statistical corrector
+  echo "  [CUSTOM:LOOP,SC]" >> results.txt
+  ./predictor --cache --custom:loop,sc ../traces/${trace}.bz2 >> results.txt
 
   echo "======" >> results.txt
 done
@@ -0,0 +1,235 @@
+//========================================================//
+//  smt.c                                                 //
+//  Source file for the multi-context (SMT) mode          //
+//                                                        //
+//  Every trace first runs alone on a fresh predictor to  //
+//  give its baseline, then all of them share one.  The   //
+//  difference in mispredictions is the interference the  //
+//  context suffers (negative when sharing helps it).     //
+//  With private history each context swaps its global    //
+//  history in when it starts fetching; the tables are    //
+//  always shared.                                        //
+//========================================================//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rng.h"
+#include "smt.h"
+
+int      smtPolicy         = SMT_OFF;
+uint32_t smtQuantum        = 1;
+int      smtPrivateHistory = 0;
+
+SmtContext *smtContext  = NULL;
+int         smtContexts = 0;
+
+static const char *policyName[3] = { "round-robin", "quantum", "random" };
+
+// Fetch RNG state of the random policy, a stream of its own so that
+// fetch choices are independent of the custom predictor's allocation
+static uint64_t fetchRngState;
+
+//------------------------------------//
+//          Helper Functions          //
+//------------------------------------//
+
+// Pick the context that fetches after 'cur', among the 'live' ones
+// that still have branches
+static int next_context(int cur, int live) {
+    if (smtPolicy == SMT_RANDOM) {
+        int k = (int)(rng_next(&fetchRngState) % (uint32_t)live);
+        for (int i = 0; i < smtContexts; i++) {
+            if (smtContext[i].live && k-- == 0) {
+                return i;
+            }
+        }
+    }
+    for (int i = 1; i <= smtContexts; i++) {
+        int c = (cur + i) % smtContexts;
+        if (smtContext[c].live) {
+            return c;
+        }
+    }
+    return cur;
+}
+
+// Run the trace of 'c' alone on a fresh predictor
+//
+// Returns True if Successful
+//
+static int run_alone(SmtContext *c) {
+    uint32_t pc;
+    uint8_t  outcome;
+
+    if (!trace_open(&c->trace, c->path)) {
+        fprintf(stderr, "Cannot open trace %s\n", c->path);
+        return 0;
+    }
+    int wasQuiet = quiet;
+    quiet = 1;
+    init_predictor();
+    quiet = wasQuiet;
+
+    c->aloneMispredictions = 0;
+    while (trace_next(&c->trace, &pc, &outcome)) {
+        if (make_prediction(pc) != outcome) {
+            c->aloneMispredictions++;
+        }
+        train_predictor(pc, outcome);
+    }
+    free_predictor();
+    int ok = !c->trace.error;
+    trace_close(&c->trace);
+    if (!ok) {
+        fprintf(stderr, "Trace %s is corrupt or truncated\n", c->path);
+    }
+    return ok;
+}
+
+//------------------------------------//
+//         SMT Mode Functions         //
+//------------------------------------//
+
+int smt_parse(const char *spec) {
+    unsigned int n;
+    if (!strcmp(spec, "rr")) {
+        smtPolicy  = SMT_ROUND_ROBIN;
+        smtQuantum = 1;
+    } else if (!strncmp(spec, "quantum:", 8)) {
+        if (sscanf(spec + 8, "%u", &n) != 1 || n == 0) {
+            return 0;
+        }
+        smtPolicy  = SMT_QUANTUM;
+        smtQuantum = n;
+    } else if (!strcmp(spec, "random")) {
+        smtPolicy  = SMT_RANDOM;
+        smtQuantum = 1;
+    } else if (!strncmp(spec, "random:", 7)) {
+        if (sscanf(spec + 7, "%u", &n) != 1 || n == 0) {
+            return 0;
+        }
+        smtPolicy  = SMT_RANDOM;
+        smtQuantum = n;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+int smt_run(const char *const *paths, int n) {
+    uint32_t pc;
+    uint8_t  outcome;
+
+    smtContext  = (SmtContext *)calloc(n, sizeof(SmtContext));
+    smtContexts = n;
+    if (!smtContext) {
+        return 0;
+    }
+
+    // Baselines
+    for (int i = 0; i < n; i++) {
+        smtContext[i].path = paths[i];
+        if (!run_alone(&smtContext[i])) {
+            return 0;
+        }
+    }
+
+    // Shared run.  Every context starts from the initial history, which
+    // is also what the predictor holds after init_predictor
+    int live = 0;
+    for (int i = 0; i < n; i++) {
+        if (!trace_open(&smtContext[i].trace, paths[i])) {
+            fprintf(stderr, "Cannot open trace %s\n", paths[i]);
+            for (int j = 0; j < i; j++) {
+                trace_close(&smtContext[j].trace);
+            }
+            return 0;
+        }
+        smtContext[i].live = 1;
+        live++;
+    }
+    rng_seed(&fetchRngState, rngSeed, RNG_STREAM_SMT_FETCH);
+    init_predictor();
+
+    int cur = n - 1;    // fetching context
+    int active = 0;     // context whose history the predictor holds
+    uint32_t left = 0;  // branches left in the current turn
+    while (live > 0) {
+        if (left == 0 || !smtContext[cur].live) {
+            cur  = next_context(cur, live);
+            left = smtQuantum;
+        }
+        SmtContext *c = &smtContext[cur];
+        if (smtPrivateHistory && cur != active) {
+            save_history(&smtContext[active].history);
+            restore_history(&c->history);
+            active = cur;
+        }
+
+        if (!trace_next(&c->trace, &pc, &outcome)) {
+            int error = c->trace.error;
+            trace_close(&c->trace);
+            c->live = 0;
+            live--;
+            if (error) {
+                fprintf(stderr, "Trace %s is corrupt or truncated\n", c->path);
+                for (int i = 0; i < n; i++) {
+                    if (smtContext[i].live) {
+                        trace_close(&smtContext[i].trace);
+                    }
+                }
+                free_predictor();
+                return 0;
+            }
+            continue;
+        }
+        c->branches++;
+        if (make_prediction(pc) != outcome) {
+            c->mispredictions++;
+        }
+        train_predictor(pc, outcome);
+        left--;
+    }
+
+    free_predictor();
+    return 1;
+}
+
+void smt_print_results() {
+    uint64_t branches = 0, incorrect = 0, alone = 0;
+
+    if (smtPolicy == SMT_ROUND_ROBIN) {
+        printf("Fetch policy:    %s\n", policyName[smtPolicy]);
+    } else {
+        printf("Fetch policy:    %s, %u branches per turn\n",
+               policyName[smtPolicy], smtQuantum);
+    }
+    printf("Global history:  %s\n", smtPrivateHistory ? "private" : "shared");
+    printf("Context   Branches  Incorrect    Rate   Alone    Extra   Delta  Trace\n");
+    for (int i = 0; i < smtContexts; i++) {
+        const SmtContext *c = &smtContext[i];
+        double n = c->branches ? (double)c->branches : 1.0;
+        printf("%7d %10llu %10llu %7.3f %7.3f %+8lld %+7.3f  %s\n", i,
+               (unsigned long long)c->branches,
+               (unsigned long long)c->mispredictions,
+               100.0 * c->mispredictions / n, 100.0 * c->aloneMispredictions / n,
+               (long long)c->mispredictions - (long long)c->aloneMispredictions,
+               100.0 * ((double)c->mispredictions - (double)c->aloneMispredictions) / n,
+               c->path);
+        branches  += c->branches;
+        incorrect += c->mispredictions;
+        alone     += c->aloneMispredictions;
+    }
+    double n = branches ? (double)branches : 1.0;
+    printf("  total %10llu %10llu %7.3f %7.3f %+8lld %+7.3f\n",
+           (unsigned long long)branches, (unsigned long long)incorrect,
+           100.0 * incorrect / n, 100.0 * alone / n,
+           (long long)incorrect - (long long)alone,
+           100.0 * ((double)incorrect - (double)alone) / n);
+}
+
+void smt_free() {
+    free(smtContext);
+    smtContext  = NULL;
+    smtContexts = 0;
+}
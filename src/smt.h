@@ -0,0 +1,70 @@
+//========================================================//
+//  smt.h                                                 //
+//  Header file for the multi-context (SMT) mode          //
+//                                                        //
+//  Interleaves several traces, one per hardware context, //
+//  into one shared predictor under a fetch policy and    //
+//  reports each context's interference                   //
+//========================================================//
+
+#ifndef SMT_H
+#define SMT_H
+
+#include <stdint.h>
+#include "predictor.h"
+#include "trace.h"
+
+//------------------------------------//
+//         SMT Mode Defines           //
+//------------------------------------//
+
+// Fetch policies
+#define SMT_OFF         -1
+#define SMT_ROUND_ROBIN  0 // switch context after every branch
+#define SMT_QUANTUM      1 // switch context after 'smtQuantum' branches
+#define SMT_RANDOM       2 // random context for each 'smtQuantum' branches
+
+extern int      smtPolicy;         // Fetch policy (SMT_OFF => single trace)
+extern uint32_t smtQuantum;        // Branches fetched per turn
+extern int      smtPrivateHistory; // Contexts keep their own global history
+
+typedef struct {
+    const char  *path;
+    Trace        trace;
+    int          live;            // trace not exhausted yet
+    HistoryState history;         // own global history, if private
+    uint64_t     branches;
+    uint64_t     mispredictions;  // sharing the predictor
+    uint64_t     aloneMispredictions;
+} SmtContext;
+
+extern SmtContext *smtContext;
+extern int         smtContexts;
+
+//------------------------------------//
+//       SMT Mode Prototypes          //
+//------------------------------------//
+
+// Set the fetch policy from 'spec': rr, quantum:<n> or random[:<n>]
+//
+// Returns True if Successful
+//
+int smt_parse(const char *spec);
+
+// Run each of the 'n' traces in 'paths' alone on a fresh predictor, then
+// all of them together on one predictor under the fetch policy.  The
+// predictor type must already be configured
+//
+// Returns True if Successful
+//
+int smt_run(const char *const *paths, int n);
+
+// Print the fetch policy and the per-context and total statistics
+//
+void smt_print_results();
+
+// Release the contexts
+//
+void smt_free();
+
+#endif
@@ -0,0 +1,166 @@
+//========================================================//
+//  sweep.c                                               //
+//  Source file for the lockstep sweep engine             //
+//                                                        //
+//  Every gshare / bimodal configuration sees the same    //
+//  PC and outcome stream, and their indices only differ  //
+//  by masking.  Keep all configurations in lanes of      //
+//  struct-of-arrays state and step them together so one  //
+//  trace pass (and one parse) serves the whole family.   //
+//========================================================//
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "predictor.h"
+#include "sweep.h"
+
+int sweepLanes = 0;
+
+//------------------------------------//
+//     Sweep Engine Data Structures   //
+//------------------------------------//
+
+// Per-lane configuration, laid out one array per field so that the
+// lane loops in sweep_step() compile to straight vector code
+static int      laneType[SWEEP_MAX_LANES];
+static int      laneBits[SWEEP_MAX_LANES];
+static uint32_t laneMask[SWEEP_MAX_LANES];     // index mask
+static uint32_t laneHistMask[SWEEP_MAX_LANES]; // history mask (0 for bimodal)
+static uint32_t laneBase[SWEEP_MAX_LANES];     // offset of the lane's table
+static uint32_t laneMiss[SWEEP_MAX_LANES];     // mispredictions
+
+// All lane tables share one allocation of 2-bit counters
+static uint8_t  *sweepCounters = NULL;
+static uint32_t sweepHistory;
+
+static const char *laneName[2] = { "GSHARE", "BIMODAL" };
+
+//------------------------------------//
+//        Sweep Engine Functions      //
+//------------------------------------//
+
+static int sweep_add_lane(int type, int bits) {
+    if (sweepLanes >= SWEEP_MAX_LANES || bits < 1 || bits > SWEEP_MAX_BITS) {
+        return 0;
+    }
+    laneType[sweepLanes] = type;
+    laneBits[sweepLanes] = bits;
+    sweepLanes++;
+    return 1;
+}
+
+int sweep_parse(const char *spec) {
+    char *copy = strdup(spec);
+    int ok = copy != NULL;
+
+    for (char *item = ok ? strtok(copy, ",") : NULL; item && ok; item = strtok(NULL, ",")) {
+        int type, lo, hi;
+        char *args;
+
+        if (!strncmp(item, "gshare:", 7)) {
+            type = SWEEP_GSHARE;
+            args = item + 7;
+        } else if (!strncmp(item, "bimodal:", 8)) {
+            type = SWEEP_BIMODAL;
+            args = item + 8;
+        } else {
+            ok = 0;
+            break;
+        }
+
+        // "<lo>-<hi>" or "<bits>", with nothing left over
+        int used = -1;
+        if (sscanf(args, "%d-%d%n", &lo, &hi, &used) != 2 || args[used] != '\0') {
+            used = -1;
+            if (sscanf(args, "%d%n", &lo, &used) != 1 || args[used] != '\0') {
+                ok = 0;
+                break;
+            }
+            hi = lo;
+        }
+        if (hi < lo) {
+            ok = 0;
+            break;
+        }
+        for (int bits = lo; bits <= hi && ok; bits++) {
+            ok = sweep_add_lane(type, bits);
+        }
+    }
+
+    free(copy);
+    return ok;
+}
+
+void sweep_init() {
+    uint32_t total = 0;
+
+    for (int l = 0; l < sweepLanes; l++) {
+        laneMask[l]     = (1u << laneBits[l]) - 1;
+        laneHistMask[l] = (laneType[l] == SWEEP_GSHARE) ? laneMask[l] : 0;
+        laneBase[l]     = total;
+        laneMiss[l]     = 0;
+        total += 1u << laneBits[l];
+    }
+
+    sweepCounters = (uint8_t *)malloc(total * sizeof(uint8_t));
+    memset(sweepCounters, WN, total * sizeof(uint8_t));
+    sweepHistory = 0;
+}
+
+void sweep_step(uint32_t pc, uint8_t outcome, uint8_t *pred) {
+    uint32_t idx[SWEEP_MAX_LANES];
+    uint8_t  ctr[SWEEP_MAX_LANES];
+    uint8_t  dir[SWEEP_MAX_LANES];
+    const int n = sweepLanes;
+
+    // 1. Index computation.  gshare's (pc & mask) ^ (history & mask) is
+    //    (pc ^ history) & mask, and bimodal is the same with no history,
+    //    so a single unmasked history register serves every lane.
+    for (int l = 0; l < n; l++) {
+        idx[l] = laneBase[l] + ((pc ^ (sweepHistory & laneHistMask[l])) & laneMask[l]);
+    }
+
+    // 2. Counter gather
+    for (int l = 0; l < n; l++) {
+        ctr[l] = sweepCounters[idx[l]];
+    }
+
+    // 3. Predict, accumulate mispredictions and saturate the counters
+    //    without branches: WT/ST (>= 2) predict taken
+    for (int l = 0; l < n; l++) {
+        uint8_t c = ctr[l];
+        dir[l] = c >> 1;
+        laneMiss[l] += (uint32_t)(dir[l] ^ outcome);
+        ctr[l] = c + (outcome & (c < ST)) - ((outcome ^ 1) & (c > SN));
+    }
+
+    if (pred) {
+        memcpy(pred, dir, n * sizeof(uint8_t));
+    }
+
+    // 4. Counter scatter
+    for (int l = 0; l < n; l++) {
+        sweepCounters[idx[l]] = ctr[l];
+    }
+
+    sweepHistory = (sweepHistory << 1) | outcome;
+}
+
+void sweep_print_results(uint32_t num_branches) {
+    for (int l = 0; l < sweepLanes; l++) {
+        unsigned int bits_used = (1u << laneBits[l]) * 2; // 2 bits each
+        printf("  [%s:%d]\n", laneName[laneType[l]], laneBits[l]);
+        printf("Approx memory usage: %u bits (%.2f KB)\n",
+               bits_used, (double)bits_used / 8192.0);
+        printf("Branches:        %10d\n", num_branches);
+        printf("Incorrect:       %10d\n", laneMiss[l]);
+        float mispredict_rate = 100*((float)laneMiss[l] / (float)num_branches);
+        printf("Misprediction Rate: %7.3f\n", mispredict_rate);
+    }
+}
+
+void sweep_free() {
+    free(sweepCounters);
+    sweepCounters = NULL;
+}
@@ -0,0 +1,56 @@
+//========================================================//
+//  sweep.h                                               //
+//  Header file for the lockstep sweep engine             //
+//                                                        //
+//  Simulates a family of gshare / bimodal configurations //
+//  over one pass of the trace, one lane per config       //
+//========================================================//
+
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <stdint.h>
+
+//------------------------------------//
+//        Sweep Engine Defines        //
+//------------------------------------//
+#define SWEEP_MAX_LANES 64
+#define SWEEP_MAX_BITS  24
+
+// Lane predictor types
+#define SWEEP_GSHARE  0
+#define SWEEP_BIMODAL 1
+
+extern int sweepLanes; // Number of configured lanes (0 => sweep mode off)
+
+//------------------------------------//
+//   Sweep Engine Function Prototypes //
+//------------------------------------//
+
+// Add the lanes described by 'spec' to the sweep.  'spec' is a comma
+// separated list of <type>:<bits> or <type>:<lo>-<hi> items where type
+// is gshare or bimodal, e.g. "gshare:8-16,bimodal:10"
+//
+// Returns True if Successful
+//
+int sweep_parse(const char *spec);
+
+// Allocate and reset the counter tables of every lane
+//
+void sweep_init();
+
+// Predict and train every lane on the branch at PC 'pc' with outcome
+// 'outcome'.  If 'pred' is not NULL the per-lane predictions are written
+// to pred[0 .. sweepLanes-1]
+//
+void sweep_step(uint32_t pc, uint8_t outcome, uint8_t *pred);
+
+// Print the memory usage and misprediction statistics of every lane
+//
+void sweep_print_results(uint32_t num_branches);
+
+// Release the counter tables
+//
+void sweep_free();
+
+#endif
@@ -0,0 +1,921 @@
+//========================================================//
+//  trace.c                                               //
+//  Source file for the branch trace reader               //
+//                                                        //
+//  Text traces are one "0x<pc> <outcome>" line per       //
+//  branch.  bzip2 traces are decoded in-process, either  //
+//  as a stream or, after an indexed seek, one block at   //
+//  a time starting from the block's bit offset.          //
+//  Columnar traces are decoded straight from their       //
+//  blocks (see bpt.c).  Cached traces are read from the  //
+//  decoded arrays (see tracecache.c).                    //
+//========================================================//
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "predictor.h"
+#include "trace.h"
+
+#define TRACE_CHUNK    (1 << 16)
+#define INDEX_MAGIC    0x58495042 // "BPIX"
+#define INDEX_VERSION  3
+
+// A trace modified this recently when it is indexed gets no trusted
+// mtime: a rewrite within the filesystem's timestamp granularity could
+// keep the same one
+#define INDEX_MTIME_SLACK 2000000000ULL // ns
+
+// bzip2 block header and end-of-stream magics (48 bits each)
+#define BZ_BLOCK_MAGIC 0x314159265359ULL
+#define BZ_EOS_MAGIC   0x177245385090ULL
+#define BZ_MAGIC_MASK  0xffffffffffffULL
+
+//------------------------------------//
+//          Helper Functions          //
+//------------------------------------//
+
+static uint64_t file_size(FILE *f) {
+    struct stat st;
+    if (fstat(fileno(f), &st) != 0) {
+        return 0;
+    }
+    return (uint64_t)st.st_size;
+}
+
+// Modification time of 'f' in ns since the epoch
+static uint64_t file_mtime(FILE *f) {
+    struct stat st;
+    if (fstat(fileno(f), &st) != 0) {
+        return 0;
+    }
+    return (uint64_t)st.st_mtim.tv_sec * 1000000000ULL + (uint64_t)st.st_mtim.tv_nsec;
+}
+
+static char *sidecar_path(const char *path) {
+    size_t n = strlen(path) + 5;
+    char *s = (char *)malloc(n);
+    snprintf(s, n, "%s.idx", path);
+    return s;
+}
+
+// Whether 'idx' was built from the current content of 'f'.  A matching
+// size and mtime is taken as proof without reading the trace, so opening
+// a window of a large trace stays cheap.  Otherwise the content is
+// hashed, since the size alone misses a trace regenerated at the same
+// size.  The read position of 'f' is kept
+static int index_current(FILE *f, const TraceIndex *idx) {
+    if (idx->traceSize != file_size(f)) {
+        return 0;
+    }
+    if (idx->traceMtime && idx->traceMtime == file_mtime(f)) {
+        return 1;
+    }
+    long at = ftell(f);
+    uint64_t key;
+    int ok = at >= 0 && trace_cache_key(f, &key) && key == idx->traceKey;
+    return at >= 0 && fseek(f, at, SEEK_SET) == 0 && ok;
+}
+
+// Read the whole file into memory
+static uint8_t *load_file(FILE *f, uint64_t *size) {
+    *size = file_size(f);
+    uint8_t *data = (uint8_t *)malloc(*size ? *size : 1);
+    if (fseek(f, 0, SEEK_SET) != 0 || fread(data, 1, *size, f) != *size) {
+        free(data);
+        return NULL;
+    }
+    return data;
+}
+
+static inline int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Parse "0x<pc> <outcome>" between 'p' and 'end'
+static inline void parse_branch(const char *p, const char *end,
+                                uint32_t *pc, uint8_t *outcome) {
+    uint32_t v = 0;
+    int o = 0, d;
+
+    if (end - p >= 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+        p += 2;
+    }
+    while (p < end && (d = hex_digit(*p)) >= 0) {
+        v = (v << 4) | (uint32_t)d;
+        p++;
+    }
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        p++;
+    }
+    while (p < end && *p >= '0' && *p <= '9') {
+        o = o * 10 + (*p - '0');
+        p++;
+    }
+    *pc = v;
+    *outcome = (uint8_t)o;
+}
+
+//------------------------------------//
+//         bzip2 Block Decoding       //
+//------------------------------------//
+
+static inline int get_bit(const uint8_t *data, uint64_t bit) {
+    return (data[bit >> 3] >> (7 - (bit & 7))) & 1;
+}
+
+static inline uint64_t get_bits(const uint8_t *data, uint64_t bit, int n) {
+    uint64_t v = 0;
+    for (int i = 0; i < n; i++) {
+        v = (v << 1) | (uint64_t)get_bit(data, bit + i);
+    }
+    return v;
+}
+
+static inline void put_bits(uint8_t *s, uint64_t *w, uint64_t v, int n) {
+    for (int i = n - 1; i >= 0; i--, (*w)++) {
+        if ((v >> i) & 1) {
+            s[*w >> 3] |= (uint8_t)(0x80 >> (*w & 7));
+        }
+    }
+}
+
+// Decode the single bzip2 block of 'bitLength' bits at bit 'bitOffset'
+// of 'data'.  The block is re-aligned into a stand-alone stream (header,
+// block, end-of-stream marker) whose combined CRC is the block CRC, the
+// same way bzip2recover splits damaged files
+//
+// Returns True if Successful
+//
+static int bz2_decode_block(const uint8_t *data, uint64_t bitOffset,
+                            uint64_t bitLength, char **out, size_t *outLen) {
+    size_t n = 4 + (size_t)((bitLength + 48 + 32 + 7) / 8);
+    uint8_t *s = (uint8_t *)calloc(n, 1);
+    uint64_t w = 32;
+
+    memcpy(s, "BZh9", 4);
+    for (uint64_t i = 0; i < bitLength; i++, w++) {
+        if (get_bit(data, bitOffset + i)) {
+            s[w >> 3] |= (uint8_t)(0x80 >> (w & 7));
+        }
+    }
+    put_bits(s, &w, BZ_EOS_MAGIC, 48);
+    put_bits(s, &w, get_bits(data, bitOffset + 48, 32), 32);
+
+    bz_stream bz;
+    memset(&bz, 0, sizeof(bz));
+    if (BZ2_bzDecompressInit(&bz, 0, 0) != BZ_OK) {
+        free(s);
+        return 0;
+    }
+
+    size_t cap = 1 << 20, len = 0;
+    char *o = (char *)malloc(cap);
+    int rc = BZ_OK;
+    bz.next_in  = (char *)s;
+    bz.avail_in = (unsigned int)n;
+    while (rc == BZ_OK) {
+        if (len == cap) {
+            cap *= 2;
+            o = (char *)realloc(o, cap);
+        }
+        bz.next_out  = o + len;
+        bz.avail_out = (unsigned int)(cap - len);
+        rc = BZ2_bzDecompress(&bz);
+        len = cap - bz.avail_out;
+        if (rc == BZ_OK && bz.avail_in == 0 && bz.avail_out > 0) {
+            break; // truncated block
+        }
+    }
+    BZ2_bzDecompressEnd(&bz);
+    free(s);
+
+    if (rc != BZ_STREAM_END) {
+        free(o);
+        return 0;
+    }
+    *out = o;
+    *outLen = len;
+    return 1;
+}
+
+//------------------------------------//
+//          Buffer Management         //
+//------------------------------------//
+
+// Drop parsed text and make room for 'extra' more bytes
+static void buf_reserve(Trace *t, size_t extra) {
+    if (t->pos > 0) {
+        memmove(t->buf, t->buf + t->pos, t->end - t->pos);
+        t->end -= t->pos;
+        t->pos = 0;
+    }
+    if (t->end + extra > t->cap) {
+        while (t->end + extra > t->cap) {
+            t->cap *= 2;
+        }
+        t->buf = (char *)realloc(t->buf, t->cap);
+    }
+}
+
+static size_t refill_text(Trace *t) {
+    buf_reserve(t, TRACE_CHUNK);
+    size_t got = fread(t->buf + t->end, 1, TRACE_CHUNK, t->file);
+    t->end += got;
+    return got;
+}
+
+static size_t refill_bz2(Trace *t) {
+    buf_reserve(t, TRACE_CHUNK);
+
+    while (t->bzActive) {
+        if (t->bz.avail_in == 0 && !t->rawEof) {
+            size_t n = fread(t->raw, 1, TRACE_CHUNK, t->file);
+            t->rawEof = (n == 0);
+            t->bz.next_in  = t->raw;
+            t->bz.avail_in = (unsigned int)n;
+        }
+
+        size_t room = t->cap - t->end;
+        t->bz.next_out  = t->buf + t->end;
+        t->bz.avail_out = (unsigned int)room;
+        int rc = BZ2_bzDecompress(&t->bz);
+        size_t got = room - t->bz.avail_out;
+        t->end += got;
+
+        if (rc == BZ_STREAM_END) {
+            // Concatenated streams continue right after this one
+            BZ2_bzDecompressEnd(&t->bz);
+            t->bzActive = 0;
+            if (t->bz.avail_in == 0 && !t->rawEof) {
+                size_t n = fread(t->raw, 1, TRACE_CHUNK, t->file);
+                t->rawEof = (n == 0);
+                t->bz.next_in  = t->raw;
+                t->bz.avail_in = (unsigned int)n;
+            }
+            if (t->bz.avail_in > 0) {
+                char *next = t->bz.next_in;
+                unsigned int avail = t->bz.avail_in;
+                memset(&t->bz, 0, sizeof(t->bz));
+                t->bz.next_in  = next;
+                t->bz.avail_in = avail;
+                t->bzActive = (BZ2_bzDecompressInit(&t->bz, 0, 0) == BZ_OK);
+            }
+        } else if (rc != BZ_OK) {
+            fprintf(stderr, "trace: corrupt bzip2 data\n");
+            BZ2_bzDecompressEnd(&t->bz);
+            t->bzActive = 0;
+            t->error = 1;
+        } else if (got == 0 && t->bz.avail_in == 0 && t->rawEof) {
+            fprintf(stderr, "trace: truncated bzip2 data\n");
+            BZ2_bzDecompressEnd(&t->bz);
+            t->bzActive = 0;
+            t->error = 1;
+        }
+
+        if (got > 0) {
+            return got;
+        }
+    }
+    return 0;
+}
+
+// Read just the bytes of the next indexed bzip2 block and decode it
+static size_t refill_block(Trace *t) {
+    if (t->nextBlock >= t->index.numEntries) {
+        return 0;
+    }
+    TraceIndexEntry *e = &t->index.entry[t->nextBlock++];
+    uint64_t first = e->offset >> 3;
+    size_t bytes = (size_t)(((e->offset + e->length + 7) >> 3) - first);
+    if (bytes > t->dataCap) {
+        uint8_t *data = (uint8_t *)realloc(t->data, bytes);
+        if (!data) {
+            fprintf(stderr, "trace: cannot allocate a bzip2 block\n");
+            t->nextBlock = t->index.numEntries;
+            t->error = 1;
+            return 0;
+        }
+        t->data = data;
+        t->dataCap = bytes;
+    }
+    char *block;
+    size_t len;
+    if (pread(fileno(t->file), t->data, bytes, (off_t)first) != (ssize_t)bytes
+        || !bz2_decode_block(t->data, e->offset & 7, e->length, &block, &len)) {
+        fprintf(stderr, "trace: cannot decode bzip2 block at bit %llu\n",
+                (unsigned long long)e->offset);
+        t->nextBlock = t->index.numEntries;
+        t->error = 1;
+        return 0;
+    }
+    buf_reserve(t, len);
+    memcpy(t->buf + t->end, block, len);
+    t->end += len;
+    free(block);
+    return len;
+}
+
+static int trace_refill(Trace *t) {
+    if (t->eof) {
+        return 0;
+    }
+    size_t got;
+    if (t->blockMode) {
+        got = refill_block(t);
+    } else if (t->format == TRACE_BZ2) {
+        got = refill_bz2(t);
+    } else {
+        got = refill_text(t);
+    }
+    if (got == 0) {
+        t->eof = 1;
+    }
+    return got > 0;
+}
+
+// Find the end of the next line, refilling as needed.  A final line
+// without a newline still counts as a branch
+//
+// Returns the length of the line (excluding the newline), or -1 at the
+// end of the trace
+//
+static inline long next_line(Trace *t) {
+    for (;;) {
+        char *line = t->buf + t->pos;
+        char *nl = (char *)memchr(line, '\n', t->end - t->pos);
+        if (nl) {
+            return nl - line;
+        }
+        if (!trace_refill(t)) {
+            return (t->pos < t->end) ? (long)(t->end - t->pos) : -1;
+        }
+    }
+}
+
+//------------------------------------//
+//        Trace Reader Functions      //
+//------------------------------------//
+
+static int trace_open_file(Trace *t, const char *path) {
+    memset(t, 0, sizeof(*t));
+    t->limit = UINT64_MAX;
+
+    if (path) {
+        t->file = fopen(path, "rb");
+        if (!t->file) {
+            return 0;
+        }
+    } else {
+        t->file = stdin;
+        t->isStdin = 1;
+    }
+
+    t->cap = TRACE_CHUNK;
+    t->buf = (char *)malloc(t->cap);
+
+    // Sniff the format from the first bytes
+    size_t n = fread(t->buf, 1, 4, t->file);
+    uint32_t magic = 0;
+    memcpy(&magic, t->buf, n == 4 ? 4 : 0);
+    if (n == 4 && magic == BPT_MAGIC) {
+        t->format = TRACE_BPT;
+        if (!bpt_open(&t->bpt, t->file)) {
+            trace_close(t);
+            return 0;
+        }
+    } else if (n == 4 && !memcmp(t->buf, "BZh", 3)) {
+        t->format = TRACE_BZ2;
+        t->raw = (char *)malloc(TRACE_CHUNK);
+        memcpy(t->raw, t->buf, 4);
+        t->bz.next_in  = t->raw;
+        t->bz.avail_in = 4;
+        t->bzActive = (BZ2_bzDecompressInit(&t->bz, 0, 0) == BZ_OK);
+    } else {
+        t->format = TRACE_TEXT;
+        t->end = n;
+    }
+
+    if (path) {
+        if (trace_index_read(path, &t->index)
+            && t->index.format == (uint32_t)t->format
+            && index_current(t->file, &t->index)) {
+            t->haveIndex = 1;
+        } else {
+            trace_index_free(&t->index);
+        }
+    }
+    return 1;
+}
+
+// Open 'path' from its trace cache entry, decoding the trace and adding
+// the entry first when missing
+static int trace_open_cached(Trace *t, const char *path) {
+    FILE *f = fopen(path, "rb");
+    uint64_t key, size;
+    if (!f) {
+        return 0;
+    }
+    size = file_size(f);
+    int ok = trace_cache_key(f, &key);
+    fclose(f);
+    if (!ok) {
+        return 0;
+    }
+
+    memset(t, 0, sizeof(*t));
+    t->limit = UINT64_MAX;
+    if (trace_cache_lookup(key, size, &t->cache)) {
+        trace_cache_trim(key);
+        t->decoded = 1;
+        return 1;
+    }
+
+    Trace src;
+    if (!trace_open_file(&src, path)) {
+        return 0;
+    }
+    uint64_t n = 0, cap = 1 << 20;
+    uint32_t *pc = (uint32_t *)malloc(cap * sizeof(uint32_t));
+    uint8_t *outcome = (uint8_t *)malloc(cap * sizeof(uint8_t));
+    while (trace_next(&src, &pc[n], &outcome[n])) {
+        if (++n == cap) {
+            cap *= 2;
+            pc = (uint32_t *)realloc(pc, cap * sizeof(uint32_t));
+            outcome = (uint8_t *)realloc(outcome, cap * sizeof(uint8_t));
+        }
+    }
+    int error = src.error;
+    trace_close(&src);
+    if (error) {
+        // Never cache a corrupt trace; reading it directly reports the
+        // error where it occurs
+        free(pc);
+        free(outcome);
+        return 0;
+    }
+
+    t->decoded = 1;
+    if (trace_cache_insert(key, size, pc, outcome, n, &t->cache)) {
+        free(pc);
+        free(outcome);
+    } else {
+        // Too big for the cache or no room in it: keep this copy private
+        t->heapPC = pc;
+        t->heapOutcome = outcome;
+        t->cache.pc = pc;
+        t->cache.outcome = outcome;
+        t->cache.branches = n;
+    }
+    return 1;
+}
+
+int trace_open(Trace *t, const char *path) {
+    if (path && traceCacheLimit && trace_open_cached(t, path)) {
+        return 1;
+    }
+    return trace_open_file(t, path);
+}
+
+// Load the next columnar block, skipping whole blocks that end at or
+// before branch 'target' without decoding them.  Sets the trace's error
+// flag if a block is bad or the file ends short of the header's count
+//
+// Returns True if Successful, False at the end of the trace or on an
+// error
+//
+static int bpt_advance(Trace *t, uint64_t target) {
+    BptBlockHeader bh;
+    while (bpt_read_block_header(t->file, &bh)) {
+        if (t->ordinal + bh.branches <= target) {
+            if (!bpt_skip_payload(t->file, &bh)) {
+                fprintf(stderr, "bpt: truncated block\n");
+                t->error = 1;
+                return 0;
+            }
+            t->ordinal += bh.branches;
+            continue;
+        }
+        if (!bpt_load_block(&t->bpt, t->file, &bh)) {
+            t->error = 1;
+            return 0;
+        }
+        return 1;
+    }
+    if (t->ordinal != t->bpt.h.branches) {
+        fprintf(stderr, "bpt: truncated trace\n");
+        t->error = 1;
+    }
+    return 0;
+}
+
+int trace_next(Trace *t, uint32_t *pc, uint8_t *outcome) {
+    if (t->error || t->ordinal >= t->limit) {
+        return 0;
+    }
+    if (t->decoded) {
+        if (t->ordinal >= t->cache.branches) {
+            return 0;
+        }
+        *pc = t->cache.pc[t->ordinal];
+        *outcome = t->cache.outcome[t->ordinal];
+        t->ordinal++;
+        return 1;
+    }
+    if (t->format == TRACE_BPT) {
+        while (!bpt_next(&t->bpt, pc, outcome)) {
+            if (t->bpt.error) {
+                t->error = 1;
+                return 0;
+            }
+            if (!bpt_advance(t, 0)) {
+                return 0;
+            }
+        }
+        t->ordinal++;
+        return 1;
+    }
+    long n = next_line(t);
+    if (n < 0) {
+        return 0;
+    }
+    const char *line = t->buf + t->pos;
+    parse_branch(line, line + n, pc, outcome);
+    t->pos += (size_t)n + 1;
+    if (t->pos > t->end) {
+        t->pos = t->end;
+    }
+    t->ordinal++;
+    return 1;
+}
+
+// Jump to index entry 'k'
+static int trace_seek_entry(Trace *t, uint64_t k) {
+    TraceIndexEntry *e = &t->index.entry[k];
+
+    t->pos = t->end = 0;
+    t->eof = 0;
+
+    if (t->format == TRACE_TEXT || t->format == TRACE_BPT) {
+        if (fseeko(t->file, (off_t)e->offset, SEEK_SET) != 0) {
+            return 0;
+        }
+        t->bpt.left = 0;
+    } else {
+        if (t->bzActive) {
+            BZ2_bzDecompressEnd(&t->bz);
+            t->bzActive = 0;
+        }
+        t->blockMode = 1;
+        t->nextBlock = k;
+        trace_refill(t);
+        t->pos = (e->skip < t->end) ? e->skip : t->end;
+    }
+    t->ordinal = e->ordinal;
+    return 1;
+}
+
+int trace_window(Trace *t, uint64_t ordinal, uint64_t count) {
+    t->limit = UINT64_MAX;
+
+    if (t->decoded) {
+        t->ordinal = (ordinal < t->cache.branches) ? ordinal : t->cache.branches;
+        t->limit = count ? ordinal + count : UINT64_MAX;
+        return 1;
+    }
+
+    if (t->haveIndex && t->index.numEntries > 0) {
+        // Last seek point at or before 'ordinal'
+        uint64_t lo = 0, hi = t->index.numEntries;
+        while (hi - lo > 1) {
+            uint64_t mid = (lo + hi) / 2;
+            if (t->index.entry[mid].ordinal <= ordinal) {
+                lo = mid;
+            } else {
+                hi = mid;
+            }
+        }
+        uint64_t at = t->index.entry[lo].ordinal;
+        if (at <= ordinal && (ordinal < t->ordinal || at > t->ordinal)) {
+            if (!trace_seek_entry(t, lo)) {
+                return 0;
+            }
+        }
+    }
+
+    if (ordinal < t->ordinal) {
+        return 0; // cannot rewind without an index
+    }
+
+    // Discard the remaining prefix
+    while (t->format == TRACE_BPT && t->ordinal < ordinal) {
+        uint32_t pc;
+        uint8_t outcome;
+        if (t->bpt.left == 0) {
+            if (!bpt_advance(t, ordinal)) {
+                break;
+            }
+        } else if (bpt_next(&t->bpt, &pc, &outcome)) {
+            t->ordinal++;
+        } else if (t->bpt.error) {
+            t->error = 1;
+            break;
+        }
+    }
+    while (t->format != TRACE_BPT && t->ordinal < ordinal) {
+        long n = next_line(t);
+        if (n < 0) {
+            break;
+        }
+        t->pos += (size_t)n + 1;
+        if (t->pos > t->end) {
+            t->pos = t->end;
+        }
+        t->ordinal++;
+    }
+
+    t->limit = count ? ordinal + count : UINT64_MAX;
+    return !t->error;
+}
+
+void trace_close(Trace *t) {
+    if (t->bzActive) {
+        BZ2_bzDecompressEnd(&t->bz);
+    }
+    if (t->file && !t->isStdin) {
+        fclose(t->file);
+    }
+    free(t->buf);
+    free(t->raw);
+    free(t->data);
+    if (t->format == TRACE_BPT) {
+        bpt_close(&t->bpt);
+    }
+    if (t->heapPC) {
+        free(t->heapPC);
+        free(t->heapOutcome);
+    } else {
+        trace_cache_release(&t->cache);
+    }
+    trace_index_free(&t->index);
+    memset(t, 0, sizeof(*t));
+}
+
+//------------------------------------//
+//          Index Functions           //
+//------------------------------------//
+
+static void index_append(TraceIndex *idx, uint64_t *cap, TraceIndexEntry e) {
+    if (idx->numEntries == *cap) {
+        *cap = *cap ? *cap * 2 : 64;
+        idx->entry = (TraceIndexEntry *)realloc(idx->entry, *cap * sizeof(TraceIndexEntry));
+    }
+    idx->entry[idx->numEntries++] = e;
+}
+
+static int index_build_text(FILE *f, uint32_t stride, TraceIndex *idx) {
+    char *chunk = (char *)malloc(TRACE_CHUNK);
+    uint64_t cap = 0, offset = 0, lines = 0;
+    int atLineStart = 1;
+    size_t n;
+
+    fseek(f, 0, SEEK_SET);
+    while ((n = fread(chunk, 1, TRACE_CHUNK, f)) > 0) {
+        for (size_t p = 0; p < n; p++) {
+            if (atLineStart) {
+                if (lines % stride == 0) {
+                    TraceIndexEntry e = { lines, offset + p, 0, 0, 0 };
+                    index_append(idx, &cap, e);
+                }
+                lines++;
+                atLineStart = 0;
+            }
+            if (chunk[p] == '\n') {
+                atLineStart = 1;
+            }
+        }
+        offset += n;
+    }
+    free(chunk);
+    idx->branches = lines;
+    return 1;
+}
+
+static int index_build_bz2(FILE *f, TraceIndex *idx) {
+    uint64_t size, cap = 0, lines = 0;
+    uint8_t *data = load_file(f, &size);
+    if (!data) {
+        return 0;
+    }
+
+    // Locate every block and end-of-stream magic at bit granularity
+    uint64_t nmarks = 0, mcap = 64;
+    uint64_t *mark = (uint64_t *)malloc(mcap * sizeof(uint64_t));
+    int      *isBlock = (int *)malloc(mcap * sizeof(int));
+    uint64_t reg = 0;
+    for (uint64_t bit = 0; bit < size * 8; bit++) {
+        reg = (reg << 1) | (uint64_t)get_bit(data, bit);
+        uint64_t m = reg & BZ_MAGIC_MASK;
+        if (bit >= 47 && (m == BZ_BLOCK_MAGIC || m == BZ_EOS_MAGIC)) {
+            if (nmarks == mcap) {
+                mcap *= 2;
+                mark = (uint64_t *)realloc(mark, mcap * sizeof(uint64_t));
+                isBlock = (int *)realloc(isBlock, mcap * sizeof(int));
+            }
+            mark[nmarks] = bit - 47;
+            isBlock[nmarks] = (m == BZ_BLOCK_MAGIC);
+            nmarks++;
+        }
+    }
+
+    // Decode each block to find where its first branch starts
+    int ok = 1, atLineStart = 1;
+    for (uint64_t i = 0; i + 1 < nmarks && ok; i++) {
+        if (!isBlock[i]) {
+            continue;
+        }
+        TraceIndexEntry e = { 0, mark[i], mark[i + 1] - mark[i], 0, 0 };
+        char *block;
+        size_t len;
+        if (!bz2_decode_block(data, e.offset, e.length, &block, &len)) {
+            ok = 0;
+            break;
+        }
+
+        int found = 0;
+        e.skip = (uint32_t)len;
+        for (size_t p = 0; p < len; p++) {
+            if (atLineStart) {
+                if (!found) {
+                    e.ordinal = lines;
+                    e.skip = (uint32_t)p;
+                    found = 1;
+                }
+                lines++;
+                atLineStart = 0;
+            }
+            if (block[p] == '\n') {
+                atLineStart = 1;
+            }
+        }
+        if (!found) {
+            e.ordinal = lines;
+        }
+        index_append(idx, &cap, e);
+        free(block);
+    }
+
+    free(mark);
+    free(isBlock);
+    free(data);
+    idx->branches = lines;
+    return ok;
+}
+
+static int index_build_bpt(FILE *f, TraceIndex *idx) {
+    BptDecoder d;
+    BptBlockHeader bh;
+    uint64_t cap = 0, lines = 0;
+
+    if (!bpt_open(&d, f)) {
+        return 0;
+    }
+    off_t offset = ftello(f);
+    while (bpt_read_block_header(f, &bh)) {
+        uint64_t length = sizeof(bh) + (uint64_t)bh.idBytes + bh.outBytes;
+        TraceIndexEntry e = { lines, (uint64_t)offset, length, 0, 0 };
+        index_append(idx, &cap, e);
+        lines += bh.branches;
+        offset += (off_t)length;
+        if (!bpt_skip_payload(f, &bh)) {
+            break;
+        }
+    }
+    uint64_t expected = d.h.branches;
+    bpt_close(&d);
+    idx->branches = lines;
+    return lines == expected;
+}
+
+int trace_index_build(const char *path, uint32_t stride, TraceIndex *idx) {
+    memset(idx, 0, sizeof(*idx));
+
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return 0;
+    }
+
+    char magic[4] = { 0 };
+    size_t n = fread(magic, 1, 4, f);
+    int ok;
+
+    idx->stride = stride ? stride : TRACE_INDEX_STRIDE;
+    idx->traceSize = file_size(f);
+    uint32_t word;
+    memcpy(&word, magic, 4);
+    if (n == 4 && word == BPT_MAGIC) {
+        idx->format = TRACE_BPT;
+        ok = index_build_bpt(f, idx);
+    } else if (n == 4 && !memcmp(magic, "BZh", 3)) {
+        idx->format = TRACE_BZ2;
+        ok = index_build_bz2(f, idx);
+    } else {
+        idx->format = TRACE_TEXT;
+        ok = index_build_text(f, idx->stride, idx);
+    }
+    ok = ok && trace_cache_key(f, &idx->traceKey);
+
+    // Taken after hashing, so a trace modified meanwhile never gets a
+    // trusted mtime
+    struct timespec now;
+    uint64_t mtime = file_mtime(f);
+    clock_gettime(CLOCK_REALTIME, &now);
+    if (mtime + INDEX_MTIME_SLACK
+        < (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec) {
+        idx->traceMtime = mtime;
+    }
+
+    fclose(f);
+    if (!ok) {
+        trace_index_free(idx);
+    }
+    return ok;
+}
+
+// The sidecar is written in host byte order
+int trace_index_write(const char *path, const TraceIndex *idx) {
+    char *ipath = sidecar_path(path);
+    FILE *f = fopen(ipath, "wb");
+    free(ipath);
+    if (!f) {
+        return 0;
+    }
+
+    uint32_t head[4] = { INDEX_MAGIC, INDEX_VERSION, idx->format, idx->stride };
+    uint64_t body[5] = { idx->branches, idx->traceSize, idx->traceMtime, idx->traceKey,
+                         idx->numEntries };
+    int ok = fwrite(head, sizeof(head), 1, f) == 1
+          && fwrite(body, sizeof(body), 1, f) == 1
+          && fwrite(idx->entry, sizeof(TraceIndexEntry), idx->numEntries, f)
+             == idx->numEntries;
+    return (fclose(f) == 0) && ok;
+}
+
+int trace_index_read(const char *path, TraceIndex *idx) {
+    memset(idx, 0, sizeof(*idx));
+
+    char *ipath = sidecar_path(path);
+    FILE *f = fopen(ipath, "rb");
+    free(ipath);
+    if (!f) {
+        return 0;
+    }
+
+    // The header must describe a known format and exactly the entries
+    // the file holds, and every entry must lie within the trace, so a
+    // corrupt or foreign sidecar is rejected before anything uses it
+    uint32_t head[4];
+    uint64_t body[5];
+    uint64_t size = file_size(f);
+    int ok = fread(head, sizeof(head), 1, f) == 1
+          && fread(body, sizeof(body), 1, f) == 1
+          && head[0] == INDEX_MAGIC && head[1] == INDEX_VERSION
+          && head[2] <= TRACE_BPT
+          && body[4] == (size - sizeof(head) - sizeof(body)) / sizeof(TraceIndexEntry)
+          && size == sizeof(head) + sizeof(body) + body[4] * sizeof(TraceIndexEntry);
+    if (ok) {
+        idx->format     = head[2];
+        idx->stride     = head[3];
+        idx->branches   = body[0];
+        idx->traceSize  = body[1];
+        idx->traceMtime = body[2];
+        idx->traceKey   = body[3];
+        idx->numEntries = body[4];
+        idx->entry = (TraceIndexEntry *)malloc((idx->numEntries ? idx->numEntries : 1)
+                                               * sizeof(TraceIndexEntry));
+        ok = idx->entry
+             && fread(idx->entry, sizeof(TraceIndexEntry), idx->numEntries, f)
+                == idx->numEntries;
+    }
+    uint64_t limit = idx->format == TRACE_BZ2 ? idx->traceSize * 8 : idx->traceSize;
+    for (uint64_t k = 0; ok && k < idx->numEntries; k++) {
+        const TraceIndexEntry *e = &idx->entry[k];
+        ok = e->offset <= limit && e->length <= limit - e->offset;
+    }
+    fclose(f);
+    if (!ok) {
+        trace_index_free(idx);
+    }
+    return ok;
+}
+
+void trace_index_free(TraceIndex *idx) {
+    free(idx->entry);
+    memset(idx, 0, sizeof(*idx));
+}
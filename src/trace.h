@@ -0,0 +1,148 @@
+//========================================================//
+//  trace.h                                               //
+//  Header file for the branch trace reader               //
+//                                                        //
+//  Reads text, bzip2 and columnar (.bpt) traces, uses a  //
+//  sidecar index to seek to arbitrary branches, and can  //
+//  serve decoded branches from the shared trace cache    //
+//========================================================//
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <bzlib.h>
+#include "bpt.h"
+#include "tracecache.h"
+
+//------------------------------------//
+//         Trace Reader Defines       //
+//------------------------------------//
+
+// Trace formats
+#define TRACE_TEXT 0
+#define TRACE_BZ2  1
+#define TRACE_BPT  2
+
+// Default number of branches between text index entries
+#define TRACE_INDEX_STRIDE 65536
+
+// One seek point of a sidecar index.  For text traces 'offset' is the
+// byte offset of branch 'ordinal'.  For bzip2 traces there is one entry
+// per compressed block: 'offset'/'length' are the bit position and size
+// of the block and 'skip' is the number of decoded bytes before the
+// first branch starting in it.  For columnar traces there is one entry
+// per block with its byte position and size
+typedef struct {
+    uint64_t ordinal;
+    uint64_t offset;
+    uint64_t length;
+    uint32_t skip;
+    uint32_t reserved;
+} TraceIndexEntry;
+
+typedef struct {
+    uint32_t format;     // TRACE_TEXT, TRACE_BZ2 or TRACE_BPT
+    uint32_t stride;     // branches between entries (text only)
+    uint64_t branches;   // total branches in the trace
+    uint64_t traceSize;  // size of the indexed file, to detect staleness
+    uint64_t traceMtime; // its modification time in ns (0 => always hash)
+    uint64_t traceKey;   // content hash of the indexed file (trace_cache_key)
+    uint64_t numEntries;
+    TraceIndexEntry *entry;
+} TraceIndex;
+
+typedef struct {
+    int       format;
+    FILE     *file;
+    int       isStdin;
+
+    // Decoded text waiting to be parsed
+    char     *buf;
+    size_t    cap, pos, end;
+    int       eof;
+
+    // Sequential bzip2 decoding
+    bz_stream bz;
+    int       bzActive;
+    char     *raw;
+    int       rawEof;
+
+    // Block-at-a-time bzip2 decoding after an indexed seek
+    int       blockMode;
+    uint8_t  *data;      // compressed bytes of the current block
+    size_t    dataCap;
+    uint64_t  nextBlock; // next index entry to decode
+
+    // Columnar decoding
+    BptDecoder bpt;
+
+    // Decoded branches, mapped from the trace cache or, if the cache
+    // could not take them, held on the heap
+    int       decoded;
+    TraceCacheEntry cache;
+    uint32_t *heapPC;
+    uint8_t  *heapOutcome;
+
+    TraceIndex index;
+    int       haveIndex;
+
+    uint64_t  ordinal;   // ordinal of the next branch
+    uint64_t  limit;     // stop before this ordinal
+    int       error;     // the trace is corrupt or truncated
+} Trace;
+
+//------------------------------------//
+//   Trace Reader Function Prototypes //
+//------------------------------------//
+
+// Open the trace at 'path', or stdin if 'path' is NULL.  The format is
+// detected from the content, and the sidecar index '<path>.idx' is
+// loaded if present and up to date.  If the trace cache is enabled a
+// file trace is instead read from its cache entry, which is created by
+// decoding the trace once when missing
+//
+// Returns True if Successful
+//
+int trace_open(Trace *t, const char *path);
+
+// Read the next branch into 'pc' and 'outcome'.  Corrupt or truncated
+// data ends the trace early and sets its error flag, which callers
+// check once trace_next returns False
+//
+// Returns True if Successful, False at the end of the trace or window
+// or on an error
+//
+int trace_next(Trace *t, uint32_t *pc, uint8_t *outcome);
+
+// Position the trace so that the next branch read is 'ordinal' (0 based)
+// and stop after 'count' branches (0 => until the end).  Uses the index
+// when available, otherwise parses and discards the prefix
+//
+// Returns True if Successful
+//
+int trace_window(Trace *t, uint64_t ordinal, uint64_t count);
+
+// Close the trace and release its buffers
+//
+void trace_close(Trace *t);
+
+// Scan the trace at 'path' and build its index, with an entry every
+// 'stride' branches for text traces and every block for bzip2 and
+// columnar traces
+//
+// Returns True if Successful
+//
+int trace_index_build(const char *path, uint32_t stride, TraceIndex *idx);
+
+// Write / read the sidecar index of the trace at 'path'
+//
+// Returns True if Successful
+//
+int trace_index_write(const char *path, const TraceIndex *idx);
+int trace_index_read(const char *path, TraceIndex *idx);
+
+void trace_index_free(TraceIndex *idx);
+
+#endif
@@ -0,0 +1,364 @@
+//========================================================//
+//  tracecache.c                                          //
+//  Source file for the shared decoded-trace cache        //
+//                                                        //
+//  Entries are files in a tmpfs directory, written to a  //
+//  temporary name and renamed into place so readers      //
+//  only ever see complete entries.  Readers map them     //
+//  read-only and shared, so every process running on     //
+//  the same trace uses one physical copy.  A hit bumps   //
+//  the entry's mtime, and every cached open evicts the   //
+//  oldest entries beyond the size bound.  An entry       //
+//  removed while mapped stays valid for the processes    //
+//  using it.                                             //
+//========================================================//
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "tracecache.h"
+
+#define CACHE_HASH_CHUNK (1 << 20)
+
+uint64_t traceCacheLimit = 0;
+const char *traceCacheDir = NULL;
+
+typedef struct {
+    char     name[64];
+    uint64_t size;
+    struct timespec used;
+} CacheFile;
+
+//------------------------------------//
+//          Helper Functions          //
+//------------------------------------//
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t hash_mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// Returns True if the path of entry 'name' fits in 'len' bytes
+static int entry_path(char *out, size_t len, const char *name) {
+    int n = snprintf(out, len, "%s/%s", trace_cache_dir(), name);
+    return n >= 0 && (size_t)n < len;
+}
+
+static void entry_name(char *out, size_t len, uint64_t key) {
+    snprintf(out, len, "%016llx.bpc", (unsigned long long)key);
+}
+
+static int is_entry(const char *name) {
+    size_t n = strlen(name);
+    return n > 4 && !strcmp(name + n - 4, ".bpc");
+}
+
+// Check that the cache directory, created first if 'create', is not a
+// symlink, belongs to this user and is closed to everyone else.  The
+// directory lives in world-writable /dev/shm, where another user could
+// create it first and plant entries or symlinks in it
+//
+// Returns True if Successful
+//
+static int cache_dir_ok(int create) {
+    static int warned = 0;
+    const char *dir = trace_cache_dir();
+    struct stat st;
+
+    if (create && mkdir(dir, 0700) != 0 && errno != EEXIST) {
+        return 0;
+    }
+    if (lstat(dir, &st) != 0) {
+        return 0;
+    }
+    if (!S_ISDIR(st.st_mode) || st.st_uid != geteuid() || (st.st_mode & 077) != 0) {
+        if (!warned) {
+            fprintf(stderr, "Not using trace cache %s: not a private directory of this user\n",
+                    dir);
+            warned = 1;
+        }
+        return 0;
+    }
+    return 1;
+}
+
+static int write_all(int fd, const void *buf, size_t n) {
+    const uint8_t *p = (const uint8_t *)buf;
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w <= 0) {
+            return 0;
+        }
+        p += w;
+        n -= (size_t)w;
+    }
+    return 1;
+}
+
+static int older_first(const void *a, const void *b) {
+    const CacheFile *x = (const CacheFile *)a, *y = (const CacheFile *)b;
+    if (x->used.tv_sec != y->used.tv_sec) {
+        return x->used.tv_sec < y->used.tv_sec ? -1 : 1;
+    }
+    if (x->used.tv_nsec != y->used.tv_nsec) {
+        return x->used.tv_nsec < y->used.tv_nsec ? -1 : 1;
+    }
+    return 0;
+}
+
+// Collect the entries of the cache directory, oldest first
+//
+// Returns the number of entries
+//
+static int scan_entries(CacheFile **files, uint64_t *total) {
+    DIR *dir = cache_dir_ok(0) ? opendir(trace_cache_dir()) : NULL;
+    int n = 0, cap = 0;
+    *files = NULL;
+    *total = 0;
+    if (!dir) {
+        return 0;
+    }
+    struct dirent *de;
+    while ((de = readdir(dir)) != NULL) {
+        char path[PATH_MAX];
+        struct stat st;
+        if (!is_entry(de->d_name) || strlen(de->d_name) >= sizeof((*files)->name)) {
+            continue;
+        }
+        if (!entry_path(path, sizeof(path), de->d_name)
+            || lstat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+        if (n == cap) {
+            cap = cap ? cap * 2 : 16;
+            *files = (CacheFile *)realloc(*files, cap * sizeof(CacheFile));
+        }
+        snprintf((*files)[n].name, sizeof((*files)[n].name), "%s", de->d_name);
+        (*files)[n].size = (uint64_t)st.st_size;
+        (*files)[n].used = st.st_mtim;
+        *total += (uint64_t)st.st_size;
+        n++;
+    }
+    closedir(dir);
+    qsort(*files, n, sizeof(CacheFile), older_first);
+    return n;
+}
+
+// Remove the least recently used entries, except 'keep', until the
+// cache fits in 'limit' bytes
+static void evict(uint64_t limit, const char *keep) {
+    CacheFile *files;
+    uint64_t total;
+    int n = scan_entries(&files, &total);
+    for (int i = 0; i < n && total > limit; i++) {
+        char path[PATH_MAX];
+        if (!strcmp(files[i].name, keep)) {
+            continue;
+        }
+        if (entry_path(path, sizeof(path), files[i].name) && unlink(path) == 0) {
+            total -= files[i].size;
+        }
+    }
+    free(files);
+}
+
+//------------------------------------//
+//       Trace Cache Functions        //
+//------------------------------------//
+
+const char *trace_cache_dir() {
+    static char dir[64];
+    if (traceCacheDir) {
+        return traceCacheDir;
+    }
+    if (!dir[0]) {
+        snprintf(dir, sizeof(dir), "%s-%u", TRACE_CACHE_DIR, (unsigned int)geteuid());
+    }
+    return dir;
+}
+
+int trace_cache_key(FILE *f, uint64_t *key) {
+    uint8_t *chunk = (uint8_t *)malloc(CACHE_HASH_CHUNK);
+    uint64_t h = 0x9E3779B97F4A7C15ULL, length = 0;
+    size_t n;
+
+    if (fseek(f, 0, SEEK_SET) != 0) {
+        free(chunk);
+        return 0;
+    }
+    while ((n = fread(chunk, 1, CACHE_HASH_CHUNK, f)) > 0) {
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            uint64_t w;
+            memcpy(&w, chunk + i, 8);
+            h = rotl64(h ^ (w * 0x87C37B91114253D5ULL), 31) * 0x4CF5AD432745937FULL;
+        }
+        for (; i < n; i++) {
+            h = rotl64(h ^ (chunk[i] * 0x87C37B91114253D5ULL), 31) * 0x4CF5AD432745937FULL;
+        }
+        length += n;
+    }
+    free(chunk);
+
+    *key = hash_mix(h ^ length);
+    return !ferror(f) && fseek(f, 0, SEEK_SET) == 0;
+}
+
+int trace_cache_lookup(uint64_t key, uint64_t traceSize, TraceCacheEntry *e) {
+    char name[64], path[PATH_MAX];
+    struct stat st;
+    memset(e, 0, sizeof(*e));
+
+    if (!cache_dir_ok(0)) {
+        return 0;
+    }
+    entry_name(name, sizeof(name), key);
+    if (!entry_path(path, sizeof(path), name)) {
+        return 0;
+    }
+    int fd = open(path, O_RDONLY | O_NOFOLLOW);
+    if (fd < 0) {
+        return 0;
+    }
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < sizeof(TraceCacheHeader)) {
+        close(fd);
+        return 0;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        return 0;
+    }
+
+    const TraceCacheHeader *h = (const TraceCacheHeader *)map;
+    if (h->magic != TRACE_CACHE_MAGIC || h->version != TRACE_CACHE_VERSION
+        || h->key != key || h->traceSize != traceSize
+        || (uint64_t)st.st_size != sizeof(*h) + h->branches * 5) {
+        munmap(map, (size_t)st.st_size);
+        close(fd);
+        return 0;
+    }
+
+    // Mark as recently used
+    futimens(fd, NULL);
+    close(fd);
+
+    e->map      = map;
+    e->mapSize  = (size_t)st.st_size;
+    e->branches = h->branches;
+    e->pc       = (const uint32_t *)(h + 1);
+    e->outcome  = (const uint8_t *)(e->pc + h->branches);
+    return 1;
+}
+
+int trace_cache_insert(uint64_t key, uint64_t traceSize, const uint32_t *pc,
+                       const uint8_t *outcome, uint64_t n, TraceCacheEntry *e) {
+    char name[64], path[PATH_MAX], tmp[PATH_MAX + 32];
+    TraceCacheHeader h = { TRACE_CACHE_MAGIC, TRACE_CACHE_VERSION, key, traceSize, n };
+
+    if (sizeof(h) + n * 5 > traceCacheLimit) {
+        return 0;
+    }
+    if (!cache_dir_ok(1)) {
+        return 0;
+    }
+
+    entry_name(name, sizeof(name), key);
+    if (!entry_path(path, sizeof(path), name)) {
+        return 0;
+    }
+    int len = snprintf(tmp, sizeof(tmp), "%s.tmp.%d", path, (int)getpid());
+    if (len < 0 || (size_t)len >= sizeof(tmp)) {
+        return 0;
+    }
+
+    // Left over if an earlier process with this pid was interrupted
+    unlink(tmp);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW, 0600);
+    if (fd < 0) {
+        return 0;
+    }
+    int ok = write_all(fd, &h, sizeof(h))
+          && write_all(fd, pc, n * sizeof(uint32_t))
+          && write_all(fd, outcome, n * sizeof(uint8_t));
+    ok = (close(fd) == 0) && ok;
+    if (!ok || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return 0;
+    }
+
+    trace_cache_trim(key);
+    return trace_cache_lookup(key, traceSize, e);
+}
+
+void trace_cache_trim(uint64_t key) {
+    char name[64];
+    entry_name(name, sizeof(name), key);
+    evict(traceCacheLimit, name);
+}
+
+void trace_cache_release(TraceCacheEntry *e) {
+    if (e->map) {
+        munmap(e->map, e->mapSize);
+    }
+    memset(e, 0, sizeof(*e));
+}
+
+void trace_cache_list(FILE *out) {
+    CacheFile *files;
+    uint64_t total;
+    int n = scan_entries(&files, &total);
+    time_t now = time(NULL);
+
+    fprintf(out, "%s: %d entries, %.1f MB\n", trace_cache_dir(), n, total / 1048576.0);
+    for (int i = n - 1; i >= 0; i--) {
+        char path[PATH_MAX];
+        TraceCacheHeader h;
+        FILE *f = entry_path(path, sizeof(path), files[i].name)
+                  ? fopen(path, "rb") : NULL;
+        if (!f) {
+            continue;
+        }
+        if (fread(&h, sizeof(h), 1, f) == 1 && h.magic == TRACE_CACHE_MAGIC) {
+            fprintf(out, "  %016llx %10llu branches %8.1f MB  used %lds ago\n",
+                    (unsigned long long)h.key, (unsigned long long)h.branches,
+                    files[i].size / 1048576.0, (long)(now - files[i].used.tv_sec));
+        }
+        fclose(f);
+    }
+    free(files);
+}
+
+int trace_cache_clear() {
+    DIR *dir = cache_dir_ok(0) ? opendir(trace_cache_dir()) : NULL;
+    int removed = 0;
+    if (!dir) {
+        return 0;
+    }
+    struct dirent *de;
+    while ((de = readdir(dir)) != NULL) {
+        char path[PATH_MAX];
+        if (!is_entry(de->d_name) && !strstr(de->d_name, ".bpc.tmp.")) {
+            continue;
+        }
+        removed += entry_path(path, sizeof(path), de->d_name) && unlink(path) == 0;
+    }
+    closedir(dir);
+    return removed;
+}
@@ -0,0 +1,96 @@
+//========================================================//
+//  tracecache.h                                          //
+//  Header file for the shared decoded-trace cache        //
+//                                                        //
+//  Keeps decoded (pc, outcome) arrays in shared memory,  //
+//  keyed by a hash of the trace content, so repeated     //
+//  runs map them instead of decoding the trace again     //
+//========================================================//
+
+#ifndef TRACECACHE_H
+#define TRACECACHE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+//------------------------------------//
+//        Trace Cache Defines         //
+//------------------------------------//
+#define TRACE_CACHE_MAGIC   0x43435042 // "BPCC"
+#define TRACE_CACHE_VERSION 1
+#define TRACE_CACHE_DIR     "/dev/shm/bptrace-cache" // + "-<uid>"
+#define TRACE_CACHE_MB      1024       // default size bound
+
+// An entry is this header followed by the pc column (uint32_t per
+// branch) and the outcome column (uint8_t per branch), in host byte
+// order.  The file is named after the key
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;        // content hash of the source trace
+    uint64_t traceSize;  // size of the source trace
+    uint64_t branches;
+} TraceCacheHeader;
+
+// A read-only mapping of one entry
+typedef struct {
+    void           *map;
+    size_t          mapSize;
+    const uint32_t *pc;
+    const uint8_t  *outcome;
+    uint64_t        branches;
+} TraceCacheEntry;
+
+extern uint64_t traceCacheLimit; // Size bound in bytes (0 => cache off)
+extern const char *traceCacheDir;  // NULL => TRACE_CACHE_DIR-<uid>
+
+//------------------------------------//
+//  Trace Cache Function Prototypes   //
+//------------------------------------//
+
+// The cache directory in use.  The cache is only used while the
+// directory is a real directory owned by this user and closed to others
+//
+const char *trace_cache_dir();
+
+// Hash the whole content of 'f' into 'key'
+//
+// Returns True if Successful
+//
+int trace_cache_key(FILE *f, uint64_t *key);
+
+// Map the entry for 'key' if it exists and matches 'traceSize', and mark
+// it as recently used
+//
+// Returns True if Successful
+//
+int trace_cache_lookup(uint64_t key, uint64_t traceSize, TraceCacheEntry *e);
+
+// Store 'n' decoded branches under 'key', evict the least recently used
+// entries beyond the size bound, and map the new entry
+//
+// Returns True if Successful
+//
+int trace_cache_insert(uint64_t key, uint64_t traceSize, const uint32_t *pc,
+                       const uint8_t *outcome, uint64_t n, TraceCacheEntry *e);
+
+// Evict the least recently used entries, other than the one for 'key',
+// until the cache fits in the size bound
+//
+void trace_cache_trim(uint64_t key);
+
+// Unmap an entry.  Other processes keep their own mappings
+//
+void trace_cache_release(TraceCacheEntry *e);
+
+// Print the entries, most recently used first
+//
+void trace_cache_list(FILE *out);
+
+// Remove every entry, and temporary files left by interrupted writers
+//
+// Returns the number of files removed
+//
+int trace_cache_clear();
+
+#endif
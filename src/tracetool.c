@@ -0,0 +1,230 @@
+//========================================================//
+//  tracetool.c                                           //
+//  Utility for preparing branch trace files              //
+//                                                        //
+//  Converts traces to the columnar .bpt format and       //
+//  builds the sidecar index used by predictor --window   //
+//========================================================//
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+
+static const char *formatName[3] = { "text", "bzip2", "columnar" };
+
+// Print out the Usage information to stderr
+//
+void
+usage()
+{
+  fprintf(stderr,"Usage: tracetool <command> [<args>]\n");
+  fprintf(stderr," Commands:\n");
+  fprintf(stderr," encode [--packed] <trace> <out.bpt>\n"
+                 "              Convert a text, bzip2 or columnar trace (- for\n"
+                 "              stdin) to the columnar format.  --packed stores\n"
+                 "              outcomes as raw bits, trading size for speed\n");
+  fprintf(stderr," decode <trace>\n"
+                 "              Print a trace as text on stdout\n");
+  fprintf(stderr," index [--stride:<n>] <trace>...\n"
+                 "              Write the seek index <trace>.idx, with an entry\n"
+                 "              every <n> branches for text traces and every\n"
+                 "              block for bzip2 and columnar traces\n");
+  fprintf(stderr," info <trace>...\n"
+                 "              Print the seek index of each trace\n");
+  fprintf(stderr," cache list|clear\n"
+                 "              List or remove the decoded traces shared by\n"
+                 "              predictor --cache runs (%s)\n", trace_cache_dir());
+}
+
+int
+cmd_encode(int argc, char *argv[])
+{
+  int packed = 0;
+  const char *in = NULL, *out = NULL;
+
+  for (int i = 0; i < argc; ++i) {
+    if (!strcmp(argv[i],"--packed")) {
+      packed = 1;
+    } else if (!in) {
+      in = argv[i];
+    } else if (!out) {
+      out = argv[i];
+    } else {
+      usage();
+      return 1;
+    }
+  }
+  if (!in || !out) {
+    usage();
+    return 1;
+  }
+
+  Trace t;
+  if (!trace_open(&t, strcmp(in,"-") ? in : NULL)) {
+    fprintf(stderr,"Cannot open trace %s\n", in);
+    return 1;
+  }
+
+  // Columns are encoded from the whole trace held in memory
+  uint64_t n = 0, cap = 1 << 20;
+  uint32_t *pc = (uint32_t *)malloc(cap * sizeof(uint32_t));
+  uint8_t  *outcome = (uint8_t *)malloc(cap * sizeof(uint8_t));
+  int allocated = pc && outcome;
+  while (allocated && trace_next(&t, &pc[n], &outcome[n])) {
+    if (++n == cap) {
+      cap *= 2;
+      uint32_t *morePC = (uint32_t *)realloc(pc, cap * sizeof(uint32_t));
+      pc = morePC ? morePC : pc;
+      uint8_t *moreOutcome = (uint8_t *)realloc(outcome, cap * sizeof(uint8_t));
+      outcome = moreOutcome ? moreOutcome : outcome;
+      allocated = morePC && moreOutcome;
+    }
+  }
+  int error = t.error;
+  trace_close(&t);
+  if (!allocated || error) {
+    if (!allocated) {
+      fprintf(stderr,"Cannot hold trace %s in memory\n", in);
+    } else {
+      fprintf(stderr,"Trace %s is corrupt or truncated\n", in);
+    }
+    free(pc);
+    free(outcome);
+    return 1;
+  }
+
+  FILE *f = fopen(out, "wb");
+  int ok = f && bpt_encode(f, pc, outcome, n, packed);
+  if (f) {
+    ok = (fclose(f) == 0) && ok;
+  }
+  free(pc);
+  free(outcome);
+  if (!ok) {
+    fprintf(stderr,"Cannot write %s\n", out);
+    return 1;
+  }
+
+  printf("%s: %llu branches encoded\n", out, (unsigned long long)n);
+  return 0;
+}
+
+int
+cmd_decode(int argc, char *argv[])
+{
+  Trace t;
+  uint32_t pc;
+  uint8_t outcome;
+
+  if (argc != 1) {
+    usage();
+    return 1;
+  }
+  if (!trace_open(&t, argv[0])) {
+    fprintf(stderr,"Cannot open trace %s\n", argv[0]);
+    return 1;
+  }
+  while (trace_next(&t, &pc, &outcome)) {
+    printf("0x%x %d\n", pc, outcome);
+  }
+  int error = t.error;
+  trace_close(&t);
+  if (error) {
+    fprintf(stderr,"Trace %s is corrupt or truncated\n", argv[0]);
+    return 1;
+  }
+  return 0;
+}
+
+int
+cmd_index(int argc, char *argv[])
+{
+  uint32_t stride = TRACE_INDEX_STRIDE;
+
+  for (int i = 0; i < argc; ++i) {
+    if (!strncmp(argv[i],"--stride:",9)) {
+      sscanf(argv[i]+9,"%u", &stride);
+      continue;
+    }
+
+    TraceIndex idx;
+    if (!trace_index_build(argv[i], stride, &idx) ||
+        !trace_index_write(argv[i], &idx)) {
+      fprintf(stderr,"Cannot index %s\n", argv[i]);
+      return 1;
+    }
+    printf("%s: %llu branches, %llu seek points (%s)\n", argv[i],
+           (unsigned long long)idx.branches,
+           (unsigned long long)idx.numEntries, formatName[idx.format]);
+    trace_index_free(&idx);
+  }
+  return 0;
+}
+
+int
+cmd_info(int argc, char *argv[])
+{
+  for (int i = 0; i < argc; ++i) {
+    TraceIndex idx;
+    if (!trace_index_read(argv[i], &idx)) {
+      fprintf(stderr,"No index for %s\n", argv[i]);
+      return 1;
+    }
+    printf("%s: %s, %llu branches, %llu bytes, key %016llx\n", argv[i],
+           formatName[idx.format], (unsigned long long)idx.branches,
+           (unsigned long long)idx.traceSize, (unsigned long long)idx.traceKey);
+    for (uint64_t k = 0; k < idx.numEntries; k++) {
+      TraceIndexEntry *e = &idx.entry[k];
+      printf("  branch %10llu  offset %12llu  length %10llu  skip %6u\n",
+             (unsigned long long)e->ordinal, (unsigned long long)e->offset,
+             (unsigned long long)e->length, e->skip);
+    }
+    trace_index_free(&idx);
+  }
+  return 0;
+}
+
+int
+cmd_cache(int argc, char *argv[])
+{
+  if (argc != 1) {
+    usage();
+    return 1;
+  }
+  if (!strcmp(argv[0],"list")) {
+    trace_cache_list(stdout);
+  } else if (!strcmp(argv[0],"clear")) {
+    printf("Removed %d files from %s\n", trace_cache_clear(), trace_cache_dir());
+  } else {
+    usage();
+    return 1;
+  }
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  if (argc < 3) {
+    usage();
+    exit(1);
+  }
+
+  if (!strcmp(argv[1],"encode")) {
+    return cmd_encode(argc - 2, argv + 2);
+  } else if (!strcmp(argv[1],"decode")) {
+    return cmd_decode(argc - 2, argv + 2);
+  } else if (!strcmp(argv[1],"index")) {
+    return cmd_index(argc - 2, argv + 2);
+  } else if (!strcmp(argv[1],"info")) {
+    return cmd_info(argc - 2, argv + 2);
+  } else if (!strcmp(argv[1],"cache")) {
+    return cmd_cache(argc - 2, argv + 2);
+  }
+
+  printf("Unrecognized command %s\n", argv[1]);
+  usage();
+  exit(1);
+}
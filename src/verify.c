@@ -0,0 +1,900 @@
+//========================================================//
+//  verify.c                                              //
+//  Differential verification harness                     //
+//                                                        //
+//  Runs the reference scalar predictors and the          //
+//  optimized engines side by side over the same branch  //
+//  streams and checks that every prediction matches,     //
+//  branch by branch                                      //
+//========================================================//
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "predictor.h"
+#include "pipeline.h"
+#include "rng.h"
+#include "smt.h"
+#include "sweep.h"
+#include "trace.h"
+
+#define SYNTH_BRANCHES 300000
+
+typedef struct {
+  char      name[64];
+  uint64_t  n;
+  uint32_t *pc;
+  uint8_t  *outcome;
+} Stream;
+
+typedef struct {
+  const char *name;
+  int (*run)(const Stream *s, char *detail, size_t len);
+} Check;
+
+// Harness RNG (splitmix64), independent of any predictor's state
+static uint64_t harnessState = 240;
+
+static uint64_t
+harness_random()
+{
+  return splitmix64(&harnessState);
+}
+
+//------------------------------------//
+//          Branch Streams            //
+//------------------------------------//
+
+static void
+stream_alloc(Stream *s, const char *name, uint64_t n)
+{
+  snprintf(s->name, sizeof(s->name), "%s", name);
+  s->n = n;
+  s->pc = (uint32_t *)malloc((n ? n : 1) * sizeof(uint32_t));
+  s->outcome = (uint8_t *)malloc((n ? n : 1) * sizeof(uint8_t));
+}
+
+static void
+stream_free(Stream *s)
+{
+  free(s->pc);
+  free(s->outcome);
+}
+
+// Nested loops with random trip counts and a data dependent branch
+static void
+synth_loops(Stream *s)
+{
+  uint64_t i = 0;
+  stream_alloc(s, "synth:loops", SYNTH_BRANCHES);
+  while (i < s->n) {
+    int outer = 2 + harness_random() % 20;
+    for (int o = 0; o < outer && i < s->n; o++) {
+      int inner = 1 + harness_random() % 9;
+      for (int k = 0; k <= inner && i < s->n; k++, i++) {
+        s->pc[i] = 0x400100;
+        s->outcome[i] = (k < inner);
+      }
+      if (i < s->n) {
+        s->pc[i] = 0x400180;
+        s->outcome[i++] = (harness_random() % 4) == 0;
+      }
+      if (i < s->n) {
+        s->pc[i] = 0x4001c0;
+        s->outcome[i++] = (o + 1 < outer);
+      }
+    }
+  }
+}
+
+// Many static branches, each with its own bias
+static void
+synth_biased(Stream *s)
+{
+  uint32_t bias[1024];
+  stream_alloc(s, "synth:biased", SYNTH_BRANCHES);
+  for (int k = 0; k < 1024; k++) {
+    bias[k] = harness_random() % 101;
+  }
+  for (uint64_t i = 0; i < s->n; i++) {
+    uint32_t k = harness_random() % 1024;
+    s->pc[i] = 0x10000 + 4 * k;
+    s->outcome[i] = (harness_random() % 100) < bias[k];
+  }
+}
+
+// PCs spread over the whole address space to exercise index masking
+static void
+synth_aliasing(Stream *s)
+{
+  uint32_t pcs[20000];
+  uint32_t history = 0;
+  stream_alloc(s, "synth:aliasing", SYNTH_BRANCHES);
+  for (int k = 0; k < 20000; k++) {
+    pcs[k] = (uint32_t)harness_random();
+  }
+  for (uint64_t i = 0; i < s->n; i++) {
+    uint32_t pc = pcs[harness_random() % 20000];
+    s->pc[i] = pc;
+    s->outcome[i] = ((pc >> 7) ^ history ^ (history >> 3)) & 1;
+    history = (history << 1) | s->outcome[i];
+  }
+}
+
+// Outcomes correlated with older outcomes of other branches
+static void
+synth_correlated(Stream *s)
+{
+  stream_alloc(s, "synth:correlated", SYNTH_BRANCHES);
+  for (uint64_t i = 0; i < s->n; i++) {
+    s->pc[i] = 0x8000 + 8 * (i % 64);
+    if (i < 8) {
+      s->outcome[i] = harness_random() & 1;
+    } else {
+      uint8_t noise = (harness_random() % 64) == 0;
+      s->outcome[i] = s->outcome[i - 3] ^ s->outcome[i - 7] ^ noise;
+    }
+  }
+}
+
+// Load a whole trace (any format the reader supports)
+static int
+load_trace(Stream *s, const char *path)
+{
+  Trace t;
+  uint64_t cap = 1 << 20;
+
+  if (!trace_open(&t, path)) {
+    return 0;
+  }
+  stream_alloc(s, path, cap);
+  s->n = 0;
+  while (trace_next(&t, &s->pc[s->n], &s->outcome[s->n])) {
+    if (++s->n == cap) {
+      cap *= 2;
+      s->pc = (uint32_t *)realloc(s->pc, cap * sizeof(uint32_t));
+      s->outcome = (uint8_t *)realloc(s->outcome, cap * sizeof(uint8_t));
+    }
+  }
+  int error = t.error;
+  trace_close(&t);
+  if (error) {
+    stream_free(s);
+    return 0;
+  }
+  return 1;
+}
+
+//------------------------------------//
+//        Reference Predictors        //
+//------------------------------------//
+
+// Run the scalar predictor of the current configuration over 's'
+static void
+run_reference(const Stream *s, uint8_t *pred)
+{
+  init_predictor();
+  for (uint64_t i = 0; i < s->n; i++) {
+    pred[i] = make_prediction(s->pc[i]);
+    train_predictor(s->pc[i], s->outcome[i]);
+  }
+  free_predictor();
+}
+
+// Plain PC-indexed 2-bit counters
+static void
+run_reference_bimodal(const Stream *s, int bits, uint8_t *pred)
+{
+  uint32_t mask = (1u << bits) - 1;
+  uint8_t *bht = (uint8_t *)malloc((mask + 1) * sizeof(uint8_t));
+  memset(bht, WN, (mask + 1) * sizeof(uint8_t));
+  for (uint64_t i = 0; i < s->n; i++) {
+    uint8_t *c = &bht[s->pc[i] & mask];
+    pred[i] = (*c >= WT) ? TAKEN : NOTTAKEN;
+    if (s->outcome[i] == TAKEN) {
+      if (*c < ST) (*c)++;
+    } else {
+      if (*c > SN) (*c)--;
+    }
+  }
+  free(bht);
+}
+
+// Gshare whose counters are updated 'delay' branches late while its
+// history always holds the real outcomes
+static void
+run_reference_delayed_gshare(const Stream *s, int bits, int delay, uint8_t *pred)
+{
+  uint32_t mask = (1u << bits) - 1;
+  uint8_t *bht = (uint8_t *)malloc((mask + 1) * sizeof(uint8_t));
+  uint32_t *index = (uint32_t *)malloc((s->n ? s->n : 1) * sizeof(uint32_t));
+  memset(bht, WN, (mask + 1) * sizeof(uint8_t));
+  uint32_t hist = 0;
+  for (uint64_t i = 0; i <= s->n + delay; i++) {
+    if (i < s->n) {
+      index[i] = (s->pc[i] ^ hist) & mask;
+      pred[i] = (bht[index[i]] >= WT) ? TAKEN : NOTTAKEN;
+      hist = ((hist << 1) | s->outcome[i]) & mask;
+    }
+    // Branch i - delay leaves the pipeline
+    if (i >= (uint64_t)delay && i - delay < s->n) {
+      uint64_t j = i - delay;
+      uint8_t *c = &bht[index[j]];
+      if (s->outcome[j] == TAKEN) {
+        if (*c < ST) (*c)++;
+      } else {
+        if (*c > SN) (*c)--;
+      }
+    }
+  }
+  free(bht);
+  free(index);
+}
+
+// Gshare shared by two copies of the stream fetched round-robin, each
+// copy with its own history register.  pred[2i + c] is the prediction of
+// branch i in copy c
+static void
+run_reference_private_gshare(const Stream *s, int bits, uint8_t *pred)
+{
+  uint32_t mask = (1u << bits) - 1;
+  uint8_t *bht = (uint8_t *)malloc((mask + 1) * sizeof(uint8_t));
+  memset(bht, WN, (mask + 1) * sizeof(uint8_t));
+  uint32_t hist[2] = { 0, 0 };
+  for (uint64_t i = 0; i < s->n; i++) {
+    for (int c = 0; c < 2; c++) {
+      uint8_t *ctr = &bht[(s->pc[i] ^ hist[c]) & mask];
+      pred[2 * i + c] = (*ctr >= WT) ? TAKEN : NOTTAKEN;
+      if (s->outcome[i] == TAKEN) {
+        if (*ctr < ST) (*ctr)++;
+      } else {
+        if (*ctr > SN) (*ctr)--;
+      }
+      hist[c] = ((hist[c] << 1) | s->outcome[i]) & mask;
+    }
+  }
+  free(bht);
+}
+
+// Mispredictions of 'pred' on branches first, first + stride, ... < end
+static uint64_t
+count_misses(const Stream *s, const uint8_t *pred, uint64_t first,
+             uint64_t end, uint64_t stride)
+{
+  uint64_t misses = 0;
+  for (uint64_t i = first; i < end; i += stride) {
+    misses += (pred[i] != s->outcome[i]);
+  }
+  return misses;
+}
+
+// Returns the first branch where 'a' and 'b' differ, or s->n
+static uint64_t
+first_mismatch(const Stream *s, const uint8_t *a, const uint8_t *b)
+{
+  for (uint64_t i = 0; i < s->n; i++) {
+    if (a[i] != b[i]) {
+      return i;
+    }
+  }
+  return s->n;
+}
+
+//------------------------------------//
+//              Checks                //
+//------------------------------------//
+
+#define SWEEP_GSHARE_LO  4
+#define SWEEP_GSHARE_HI  16
+#define SWEEP_BIMODAL_LO 4
+#define SWEEP_BIMODAL_HI 14
+
+// Every sweep lane against the scalar gshare / reference bimodal
+static int
+check_sweep(const Stream *s, char *detail, size_t len)
+{
+  char spec[64];
+  snprintf(spec, sizeof(spec), "gshare:%d-%d,bimodal:%d-%d",
+           SWEEP_GSHARE_LO, SWEEP_GSHARE_HI, SWEEP_BIMODAL_LO, SWEEP_BIMODAL_HI);
+  sweepLanes = 0;
+  sweep_parse(spec);
+
+  // Lane predictions, one bitmap per lane
+  int lanes = sweepLanes;
+  uint64_t words = (s->n + 63) / 64;
+  uint64_t *bits = (uint64_t *)calloc(lanes * words, sizeof(uint64_t));
+  uint8_t step[SWEEP_MAX_LANES];
+
+  sweep_init();
+  for (uint64_t i = 0; i < s->n; i++) {
+    sweep_step(s->pc[i], s->outcome[i], step);
+    for (int l = 0; l < lanes; l++) {
+      bits[l * words + i / 64] |= (uint64_t)step[l] << (i % 64);
+    }
+  }
+  sweep_free();
+  sweepLanes = 0;
+
+  uint8_t *ref  = (uint8_t *)malloc(s->n ? s->n : 1);
+  uint8_t *lane = (uint8_t *)malloc(s->n ? s->n : 1);
+  int failed = 0;
+  for (int l = 0; l < lanes && !failed; l++) {
+    int isGshare = l <= SWEEP_GSHARE_HI - SWEEP_GSHARE_LO;
+    int width = isGshare ? SWEEP_GSHARE_LO + l
+                         : SWEEP_BIMODAL_LO + l - (SWEEP_GSHARE_HI - SWEEP_GSHARE_LO + 1);
+    if (isGshare) {
+      bpType = GSHARE;
+      ghistoryBits = width;
+      run_reference(s, ref);
+    } else {
+      run_reference_bimodal(s, width, ref);
+    }
+    for (uint64_t i = 0; i < s->n; i++) {
+      lane[i] = (bits[l * words + i / 64] >> (i % 64)) & 1;
+    }
+    uint64_t at = first_mismatch(s, ref, lane);
+    if (at < s->n) {
+      snprintf(detail, len, "%s:%d differs at branch %llu",
+               isGshare ? "gshare" : "bimodal", width, (unsigned long long)at);
+      failed = 1;
+    }
+  }
+
+  free(bits);
+  free(ref);
+  free(lane);
+  return !failed;
+}
+
+// The custom predictor replays identically from the same seed
+static int
+check_custom_seed(const Stream *s, char *detail, size_t len)
+{
+  uint8_t *a = (uint8_t *)malloc(s->n ? s->n : 1);
+  uint8_t *b = (uint8_t *)malloc(s->n ? s->n : 1);
+
+  bpType = CUSTOM;
+  rngSeed = 12345;
+  run_reference(s, a);
+  run_reference(s, b);
+  rngSeed = DEFAULT_RNG_SEED;
+
+  uint64_t at = first_mismatch(s, a, b);
+  if (at < s->n) {
+    snprintf(detail, len, "replay differs at branch %llu", (unsigned long long)at);
+  }
+  free(a);
+  free(b);
+  return at == s->n;
+}
+
+// Run the current configuration through the pipeline model
+static void
+run_pipeline(const Stream *s, int delay, uint8_t *pred)
+{
+  init_predictor();
+  updateDelay = delay;
+  pipeline_init();
+  for (uint64_t i = 0; i < s->n; i++) {
+    pred[i] = pipeline_step(s->pc[i], s->outcome[i]);
+  }
+  pipeline_drain();
+  pipeline_free();
+  updateDelay = -1;
+  free_predictor();
+}
+
+#define PIPELINE_DELAY 16
+
+// With no delay the pipeline model (speculative history plus repair)
+// matches every scalar predictor; with a delay, gshare matches an
+// independent delayed-update reference
+static int
+check_pipeline(const Stream *s, char *detail, size_t len)
+{
+  static const struct { int type, g, l, p, extras; const char *name; } configs[] = {
+    { GSHARE,     13, 0,  0,  0, "gshare:13" },
+    { TOURNAMENT, 9,  10, 10, 0, "tournament:9:10:10" },
+    { CUSTOM,     0,  0,  0,  0, "custom" },
+    { CUSTOM,     0,  0,  0,  1, "custom:loop,sc" },
+  };
+  uint8_t *ref  = (uint8_t *)malloc(s->n ? s->n : 1);
+  uint8_t *pipe = (uint8_t *)malloc(s->n ? s->n : 1);
+  uint64_t at = s->n;
+
+  for (size_t c = 0; c < sizeof(configs) / sizeof(configs[0]) && at == s->n; c++) {
+    bpType = configs[c].type;
+    ghistoryBits = configs[c].g;
+    lhistoryBits = configs[c].l;
+    pcIndexBits = configs[c].p;
+    customLoop = customSC = configs[c].extras;
+    run_reference(s, ref);
+    run_pipeline(s, 0, pipe);
+    at = first_mismatch(s, ref, pipe);
+    if (at < s->n) {
+      snprintf(detail, len, "%s delay 0 differs at branch %llu",
+               configs[c].name, (unsigned long long)at);
+    }
+  }
+  customLoop = customSC = 0;
+
+  if (at == s->n) {
+    bpType = GSHARE;
+    ghistoryBits = 13;
+    run_reference_delayed_gshare(s, 13, PIPELINE_DELAY, ref);
+    run_pipeline(s, PIPELINE_DELAY, pipe);
+    at = first_mismatch(s, ref, pipe);
+    if (at < s->n) {
+      snprintf(detail, len, "gshare:13 delay %d differs at branch %llu",
+               PIPELINE_DELAY, (unsigned long long)at);
+    }
+  }
+
+  free(ref);
+  free(pipe);
+  return at == s->n;
+}
+
+#define LOOP_CHECK_BRANCHES 200000
+#define LOOP_CHECK_SPACING  2
+#define LOOP_CHECK_TRIP     200
+#define LOOP_CHECK_PC       0x7ff00f
+#define LOOP_CHECK_SETS     4  // sets of the custom loop predictor
+#define LOOP_CHECK_MISSES   10 // per cent of the exits
+
+// A loop with a fixed trip count, far longer than the custom predictor's
+// history, iterates after every LOOP_CHECK_SPACING branches of 's'.  Its
+// exits are invisible to TAGE, so custom:loop must learn the trip count,
+// and keep predicting it when updates lag fetch.  Branches of 's' that
+// map to the loop's set are left out so that they cannot evict it
+static int
+check_loop(const Stream *s, char *detail, size_t len)
+{
+  uint64_t n = s->n < LOOP_CHECK_BRANCHES ? s->n : LOOP_CHECK_BRANCHES;
+  uint64_t stride = LOOP_CHECK_SPACING + 1;
+  Stream d;
+  stream_alloc(&d, "loop", n / LOOP_CHECK_SPACING * stride);
+  uint64_t k = 0, iter = 0;
+  for (uint64_t i = 0; i < s->n && k < d.n; i++) {
+    if (s->pc[i] % LOOP_CHECK_SETS == LOOP_CHECK_PC % LOOP_CHECK_SETS) {
+      continue;
+    }
+    d.pc[k] = s->pc[i];
+    d.outcome[k++] = s->outcome[i];
+    if (k % stride == LOOP_CHECK_SPACING && k < d.n) {
+      d.pc[k] = LOOP_CHECK_PC;
+      d.outcome[k++] = ++iter % LOOP_CHECK_TRIP != 0;
+    }
+  }
+  d.n = k - k % stride;
+
+  uint8_t *pred = (uint8_t *)malloc(d.n ? d.n : 1);
+  uint64_t exits = iter / LOOP_CHECK_TRIP;
+  int delays[2] = { 0, PIPELINE_DELAY };
+  int ok = 1;
+
+  bpType = CUSTOM;
+  customLoop = 1;
+  for (int c = 0; c < 2 && ok; c++) {
+    if (delays[c]) {
+      run_pipeline(&d, delays[c], pred);
+    } else {
+      run_reference(&d, pred);
+    }
+    uint64_t misses = count_misses(&d, pred, LOOP_CHECK_SPACING, d.n, stride);
+    if (misses * 100 > exits * LOOP_CHECK_MISSES) {
+      snprintf(detail, len, "custom:loop delay %d: %llu mispredictions over %llu loop exits",
+               delays[c], (unsigned long long)misses, (unsigned long long)exits);
+      ok = 0;
+    }
+  }
+  customLoop = 0;
+
+  free(pred);
+  stream_free(&d);
+  return ok;
+}
+
+// Compare 'path' read through the trace reader with 's', in full and
+// through a few indexed windows
+static int
+compare_trace_file(const Stream *s, const char *path, const char *what,
+                   char *detail, size_t len)
+{
+  Trace t;
+  uint32_t pc;
+  uint8_t outcome;
+  uint64_t i = 0;
+
+  if (!trace_open(&t, path)) {
+    snprintf(detail, len, "%s: cannot open", what);
+    return 0;
+  }
+  while (trace_next(&t, &pc, &outcome)) {
+    if (i >= s->n || pc != s->pc[i] || outcome != s->outcome[i]) {
+      break;
+    }
+    i++;
+  }
+  int error = t.error;
+  trace_close(&t);
+  if (error) {
+    snprintf(detail, len, "%s: read as corrupt", what);
+    return 0;
+  }
+  if (i != s->n) {
+    snprintf(detail, len, "%s differs at branch %llu", what, (unsigned long long)i);
+    return 0;
+  }
+
+  TraceIndex idx;
+  if (!trace_index_build(path, 4096, &idx) || !trace_index_write(path, &idx)) {
+    snprintf(detail, len, "%s: cannot index", what);
+    return 0;
+  }
+  trace_index_free(&idx);
+
+  int ok = 1;
+  for (int w = 0; w < 3 && ok && s->n > 0; w++) {
+    uint64_t start = harness_random() % s->n;
+    uint64_t count = 1 + harness_random() % 20000;
+    ok = trace_open(&t, path) && trace_window(&t, start, count);
+    for (i = start; ok && trace_next(&t, &pc, &outcome); i++) {
+      ok = (pc == s->pc[i] && outcome == s->outcome[i]);
+    }
+    ok = ok && (i == (start + count < s->n ? start + count : s->n));
+    trace_close(&t);
+    if (!ok) {
+      snprintf(detail, len, "%s window %llu:%llu differs", what,
+               (unsigned long long)start, (unsigned long long)count);
+    }
+  }
+
+  char ipath[4096];
+  snprintf(ipath, sizeof(ipath), "%s.idx", path);
+  unlink(ipath);
+  return ok;
+}
+
+// Text, columnar and packed columnar round trips through the reader
+static int
+check_trace_formats(const Stream *s, char *detail, size_t len)
+{
+  char path[] = "/tmp/verify-XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    snprintf(detail, len, "cannot create temporary file");
+    return 0;
+  }
+  close(fd);
+
+  FILE *f = fopen(path, "w");
+  for (uint64_t i = 0; i < s->n; i++) {
+    fprintf(f, "0x%x %d\n", s->pc[i], s->outcome[i]);
+  }
+  fclose(f);
+  int ok = compare_trace_file(s, path, "text", detail, len);
+
+  for (int packed = 0; packed <= 1 && ok; packed++) {
+    f = fopen(path, "wb");
+    bpt_encode(f, s->pc, s->outcome, s->n, packed);
+    fclose(f);
+    ok = compare_trace_file(s, path, packed ? "packed bpt" : "bpt", detail, len);
+  }
+
+  // An index is only trusted for the content it was built from: once the
+  // packed trace is rewritten at the same size with one outcome flipped,
+  // the reader must ignore it
+  if (ok && s->n > 0) {
+    TraceIndex idx;
+    Trace t;
+    char ipath[4096];
+    uint8_t *flipped = (uint8_t *)malloc(s->n);
+    memcpy(flipped, s->outcome, s->n);
+    flipped[0] ^= 1;
+    ok = trace_index_build(path, 0, &idx) && trace_index_write(path, &idx);
+    trace_index_free(&idx);
+    f = fopen(path, "wb");
+    bpt_encode(f, s->pc, flipped, s->n, 1);
+    fclose(f);
+    if (ok && trace_open(&t, path)) {
+      ok = !t.haveIndex;
+      trace_close(&t);
+    }
+    if (!ok) {
+      snprintf(detail, len, "index of a rewritten trace was trusted");
+    }
+
+    // Nor is a sidecar of an unknown format
+    if (ok && trace_index_build(path, 0, &idx)) {
+      idx.format = TRACE_BPT + 1;
+      ok = trace_index_write(path, &idx);
+      trace_index_free(&idx);
+      if (ok && trace_index_read(path, &idx)) {
+        trace_index_free(&idx);
+        ok = 0;
+        snprintf(detail, len, "index of an unknown format was read");
+      }
+    }
+    snprintf(ipath, sizeof(ipath), "%s.idx", path);
+    unlink(ipath);
+    free(flipped);
+  }
+
+  // A damaged block or a file cut short is an error, not an early end of
+  // the trace
+  for (int cut = 0; cut <= 1 && ok && s->n > 0; cut++) {
+    Trace t;
+    uint32_t pc;
+    uint8_t outcome;
+    f = fopen(path, "w+b");
+    bpt_encode(f, s->pc, s->outcome, s->n, 1);
+    long end = ftell(f);
+    if (!cut) {
+      fseek(f, end - 1, SEEK_SET);
+      int c = fgetc(f);
+      fseek(f, end - 1, SEEK_SET);
+      fputc(c ^ 1, f);
+    }
+    fclose(f);
+    ok = (!cut || truncate(path, end - 1) == 0) && trace_open(&t, path);
+    if (ok) {
+      while (trace_next(&t, &pc, &outcome)) {
+      }
+      ok = t.error;
+      trace_close(&t);
+    }
+    if (!ok) {
+      snprintf(detail, len, "%s trace read without an error",
+               cut ? "truncated" : "corrupt");
+    }
+  }
+
+  unlink(path);
+  return ok;
+}
+
+// Open 'path' and check that it is served from a mapped cache entry
+static int
+cache_hit(const char *path)
+{
+  Trace t;
+  if (!trace_open(&t, path)) {
+    return 0;
+  }
+  int hit = t.decoded && t.cache.map != NULL;
+  trace_close(&t);
+  return hit;
+}
+
+// Text and columnar traces through a private trace cache: the first open
+// fills it, later ones (including windows) map it, a smaller size bound
+// evicts the least recently used entry, and a directory open to other
+// users is refused
+static int
+check_trace_cache(const Stream *s, char *detail, size_t len)
+{
+  char dir[] = "/tmp/verify-cache-XXXXXX";
+  char text[] = "/tmp/verify-XXXXXX";
+  char bpt[] = "/tmp/verify-XXXXXX";
+  int fd1 = mkstemp(text), fd2 = mkstemp(bpt);
+  if (!mkdtemp(dir) || fd1 < 0 || fd2 < 0) {
+    snprintf(detail, len, "cannot create temporary files");
+    return 0;
+  }
+  close(fd1);
+  close(fd2);
+
+  FILE *f = fopen(text, "w");
+  for (uint64_t i = 0; i < s->n; i++) {
+    fprintf(f, "0x%x %d\n", s->pc[i], s->outcome[i]);
+  }
+  fclose(f);
+  f = fopen(bpt, "wb");
+  bpt_encode(f, s->pc, s->outcome, s->n, 0);
+  fclose(f);
+
+  traceCacheDir = dir;
+  traceCacheLimit = (uint64_t)1 << 40;
+  int ok = compare_trace_file(s, text, "cached text", detail, len)
+        && compare_trace_file(s, bpt, "cached bpt", detail, len);
+  if (ok && !(cache_hit(bpt) && cache_hit(text))) {
+    snprintf(detail, len, "cache entries not reused");
+    ok = 0;
+  }
+
+  // Room for one entry: reopening the text trace evicts the bpt entry
+  traceCacheLimit = sizeof(TraceCacheHeader) + s->n * 5;
+  if (ok && !(cache_hit(text) && trace_cache_clear() == 1)) {
+    snprintf(detail, len, "least recently used entry not evicted");
+    ok = 0;
+  }
+
+  // A cache directory other users can reach is not used
+  trace_cache_clear();
+  chmod(dir, 0770);
+  if (ok && cache_hit(text)) {
+    snprintf(detail, len, "cache directory open to other users was used");
+    ok = 0;
+  }
+  chmod(dir, 0700);
+
+  trace_cache_clear();
+  traceCacheLimit = 0;
+  traceCacheDir = NULL;
+  rmdir(dir);
+  unlink(text);
+  unlink(bpt);
+  return ok;
+}
+
+// Run two contexts of 'path' in SMT mode and compare each one's counts
+// with the expected mispredictions ('alone' on its own, 'misses[c]'
+// when sharing)
+static int
+smt_matches(const char *path, uint64_t n, uint64_t alone, const uint64_t *misses)
+{
+  const char *paths[2] = { path, path };
+  int ok = smt_run(paths, 2);
+  for (int c = 0; c < 2 && ok; c++) {
+    ok = smtContext[c].branches == n
+      && smtContext[c].aloneMispredictions == alone
+      && smtContext[c].mispredictions == misses[c];
+  }
+  smt_free();
+  return ok;
+}
+
+// SMT mode on two copies of the stream.  With shared history,
+// round-robin matches the scalar predictor on the interleaved stream and
+// a quantum as long as the stream matches it on the stream run twice;
+// with private history, gshare matches a two-register reference
+static int
+check_smt(const Stream *s, char *detail, size_t len)
+{
+  static const struct { int type, g; const char *name; } configs[] = {
+    { GSHARE, 13, "gshare:13" },
+    { CUSTOM, 0,  "custom" },
+  };
+  char path[] = "/tmp/verify-XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    snprintf(detail, len, "cannot create temporary file");
+    return 0;
+  }
+  close(fd);
+  FILE *f = fopen(path, "wb");
+  bpt_encode(f, s->pc, s->outcome, s->n, 0);
+  fclose(f);
+
+  Stream d;
+  stream_alloc(&d, "twice", 2 * s->n);
+  uint8_t *pred = (uint8_t *)malloc(s->n ? 2 * s->n : 1);
+  uint64_t misses[2], alone;
+  int ok = 1;
+
+  for (size_t c = 0; c < sizeof(configs) / sizeof(configs[0]) && ok; c++) {
+    bpType = configs[c].type;
+    ghistoryBits = configs[c].g;
+    run_reference(s, pred);
+    alone = count_misses(s, pred, 0, s->n, 1);
+
+    for (uint64_t i = 0; i < s->n; i++) {
+      d.pc[2 * i] = d.pc[2 * i + 1] = s->pc[i];
+      d.outcome[2 * i] = d.outcome[2 * i + 1] = s->outcome[i];
+    }
+    run_reference(&d, pred);
+    misses[0] = count_misses(&d, pred, 0, d.n, 2);
+    misses[1] = count_misses(&d, pred, 1, d.n, 2);
+    smt_parse("rr");
+    if (!smt_matches(path, s->n, alone, misses)) {
+      snprintf(detail, len, "%s round-robin differs", configs[c].name);
+      ok = 0;
+      break;
+    }
+
+    memcpy(d.pc + s->n, s->pc, s->n * sizeof(uint32_t));
+    memcpy(d.outcome + s->n, s->outcome, s->n * sizeof(uint8_t));
+    memcpy(d.pc, s->pc, s->n * sizeof(uint32_t));
+    memcpy(d.outcome, s->outcome, s->n * sizeof(uint8_t));
+    run_reference(&d, pred);
+    misses[0] = count_misses(&d, pred, 0, s->n, 1);
+    misses[1] = count_misses(&d, pred, s->n, d.n, 1);
+    smtPolicy = SMT_QUANTUM;
+    smtQuantum = s->n ? (uint32_t)s->n : 1;
+    if (!smt_matches(path, s->n, alone, misses)) {
+      snprintf(detail, len, "%s whole-trace quantum differs", configs[c].name);
+      ok = 0;
+    }
+  }
+
+  if (ok) {
+    bpType = GSHARE;
+    ghistoryBits = 13;
+    run_reference(s, pred);
+    alone = count_misses(s, pred, 0, s->n, 1);
+    for (uint64_t i = 0; i < s->n; i++) {
+      d.outcome[2 * i] = d.outcome[2 * i + 1] = s->outcome[i];
+    }
+    run_reference_private_gshare(s, 13, pred);
+    misses[0] = count_misses(&d, pred, 0, d.n, 2);
+    misses[1] = count_misses(&d, pred, 1, d.n, 2);
+    smt_parse("rr");
+    smtPrivateHistory = 1;
+    if (!smt_matches(path, s->n, alone, misses)) {
+      snprintf(detail, len, "gshare:13 private history differs");
+      ok = 0;
+    }
+  }
+
+  smtPolicy = SMT_OFF;
+  smtPrivateHistory = 0;
+  free(pred);
+  stream_free(&d);
+  unlink(path);
+  return ok;
+}
+
+static const Check checks[] = {
+  { "sweep vs scalar",     check_sweep },
+  { "custom seed replay",  check_custom_seed },
+  { "pipeline model",      check_pipeline },
+  { "loop predictor",      check_loop },
+  { "trace formats",       check_trace_formats },
+  { "trace cache",         check_trace_cache },
+  { "smt model",           check_smt },
+};
+
+//------------------------------------//
+//               Driver               //
+//------------------------------------//
+
+static int
+verify_stream(const Stream *s)
+{
+  int failures = 0;
+  for (size_t c = 0; c < sizeof(checks) / sizeof(checks[0]); c++) {
+    char detail[256] = "";
+    int ok = checks[c].run(s, detail, sizeof(detail));
+    printf("%-24s %-20s %s%s%s\n", s->name, checks[c].name,
+           ok ? "PASS" : "FAIL", *detail ? "  " : "", detail);
+    fflush(stdout);
+    failures += !ok;
+  }
+  return failures;
+}
+
+int
+main(int argc, char *argv[])
+{
+  void (*synth[])(Stream *) = {
+    synth_loops, synth_biased, synth_aliasing, synth_correlated
+  };
+  int failures = 0;
+
+  quiet = 1;
+
+  for (size_t k = 0; k < sizeof(synth) / sizeof(synth[0]); k++) {
+    Stream s;
+    synth[k](&s);
+    failures += verify_stream(&s);
+    stream_free(&s);
+  }
+
+  for (int i = 1; i < argc; ++i) {
+    Stream s;
+    if (!load_trace(&s, argv[i])) {
+      printf("%-24s cannot read\n", argv[i]);
+      failures++;
+      continue;
+    }
+    failures += verify_stream(&s);
+    stream_free(&s);
+  }
+
+  printf("%s: %d failure(s)\n", failures ? "FAILED" : "PASSED", failures);
+  return failures ? 1 : 0;
+}